@@ -0,0 +1,116 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bitstream.h"
+#include <algorithm>
+
+namespace light_plc {
+
+bitstream_t::bitstream_t(const unsigned char *data, size_t n_bytes) : d_words(n_words_for(n_bytes * 8), 0), d_size(n_bytes * 8) {
+    for (size_t i = 0; i < n_bytes; i++)
+        d_words[i / 8] |= (uint64_t)data[i] << (8 * (i % 8));
+}
+
+bitstream_t::bitstream_t(const vector_int &bits) : d_size(0) {
+    assign(bits);
+}
+
+void bitstream_t::assign(const vector_int &bits) {
+    d_words.assign(n_words_for(bits.size()), 0);
+    d_size = bits.size();
+    for (size_t i = 0; i < bits.size(); i++)
+        d_words[i / WORD_BITS] |= (uint64_t)(bits[i] & 1) << (i % WORD_BITS);
+}
+
+uint64_t bitstream_t::get_bits(size_t pos, int n) const {
+    assert(n >= 0 && n <= WORD_BITS);
+    size_t w = pos / WORD_BITS;
+    int offset = pos % WORD_BITS;
+    if (n == 0 || w >= d_words.size())
+        return 0;
+    uint64_t bits = d_words[w] >> offset;
+    if (offset && offset + n > WORD_BITS && w + 1 < d_words.size())
+        bits |= d_words[w + 1] << (WORD_BITS - offset);
+    return bits & low_bits_mask(n);
+}
+
+void bitstream_t::set_bits(size_t pos, int n, uint64_t bits) {
+    assert(n >= 0 && n <= WORD_BITS && pos + n <= d_size);
+    if (n == 0)
+        return;
+    size_t w = pos / WORD_BITS;
+    int offset = pos % WORD_BITS;
+    uint64_t mask = low_bits_mask(n);
+    bits &= mask;
+    d_words[w] = (d_words[w] & ~(mask << offset)) | (bits << offset);
+    if (offset + n > WORD_BITS)
+        d_words[w + 1] = (d_words[w + 1] & ~(mask >> (WORD_BITS - offset))) | (bits >> (WORD_BITS - offset));
+}
+
+void bitstream_t::append_bits(uint64_t bits, int n) {
+    assert(n >= 0 && n <= WORD_BITS);
+    if (n == 0)
+        return;
+    bits &= low_bits_mask(n);
+    int offset = d_size % WORD_BITS;
+    if (offset == 0)
+        d_words.push_back(bits);
+    else {
+        d_words.back() |= bits << offset;
+        if (offset + n > WORD_BITS)
+            d_words.push_back(bits >> (WORD_BITS - offset));
+    }
+    d_size += n;
+}
+
+void bitstream_t::append(const bitstream_t &other, size_t begin, size_t end) {
+    assert(begin <= end && end <= other.size());
+    reserve(d_size + end - begin);
+    for (size_t pos = begin; pos < end; pos += WORD_BITS) {
+        int n = std::min<size_t>(WORD_BITS, end - pos);
+        append_bits(other.get_bits(pos, n), n);
+    }
+}
+
+void bitstream_t::resize(size_t n_bits) {
+    d_words.resize(n_words_for(n_bits), 0);
+    d_size = n_bits;
+    if (d_size % WORD_BITS)
+        d_words.back() &= low_bits_mask(d_size % WORD_BITS);
+}
+
+size_t bitstream_t::count() const {
+    size_t n = 0;
+    for (uint64_t word : d_words)
+        n += __builtin_popcountll(word);
+    return n;
+}
+
+void bitstream_t::to_bytes(unsigned char *data) const {
+    for (size_t i = 0; i < d_size / 8; i++)
+        data[i] = d_words[i / 8] >> (8 * (i % 8));
+}
+
+vector_int bitstream_t::to_vector_int() const {
+    vector_int bits(d_size);
+    for (size_t i = 0; i < d_size; i++)
+        bits[i] = (d_words[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+    return bits;
+}
+
+} /* namespace light_plc */
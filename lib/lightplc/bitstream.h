@@ -0,0 +1,90 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIGHT_PLC_BITSTREAM
+#define _LIGHT_PLC_BITSTREAM
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "defs.h"
+
+namespace light_plc {
+
+/*
+ * Bitstream packed LSB first into 64-bit words: bit i is bit i%64 of word i/64 (so byte k of the
+ * stream is byte k%8 of word k/8, matching the octet order of the MPDU). The unused bits of the last
+ * word are always zero, so whole words can be copied, XORed and counted.
+ */
+class bitstream_t
+{
+public:
+    static const int WORD_BITS = 64;
+
+    bitstream_t() : d_size(0) {}
+    explicit bitstream_t(size_t n_bits) : d_words(n_words_for(n_bits), 0), d_size(n_bits) {}
+    bitstream_t(const unsigned char *data, size_t n_bytes);
+    explicit bitstream_t(const vector_int &bits);
+    void assign(const vector_int &bits); // reuses the words already allocated
+
+    size_t size() const { return d_size; }
+    bool empty() const { return d_size == 0; }
+    int at(size_t i) const { assert(i < d_size); return (d_words[i / WORD_BITS] >> (i % WORD_BITS)) & 1; }
+    int operator[](size_t i) const { return at(i); }
+    void set(size_t i, int bit) {
+        assert(i < d_size);
+        uint64_t mask = (uint64_t)1 << (i % WORD_BITS);
+        d_words[i / WORD_BITS] = bit ? d_words[i / WORD_BITS] | mask : d_words[i / WORD_BITS] & ~mask;
+    }
+
+    // Returns n (<= 64) bits starting at bit pos, the first bit as LSB. Bits past the end read as zero
+    uint64_t get_bits(size_t pos, int n) const;
+    void set_bits(size_t pos, int n, uint64_t bits);
+    // Appends the n (<= 64) low bits of bits, LSB first
+    void append_bits(uint64_t bits, int n);
+    // Appends bits [begin, end) of other
+    void append(const bitstream_t &other, size_t begin, size_t end);
+    void append(const bitstream_t &other) { append(other, 0, other.size()); }
+    void reserve(size_t n_bits) { d_words.reserve(n_words_for(n_bits)); }
+    void resize(size_t n_bits);
+    size_t count() const;
+
+    uint64_t *words() { return d_words.data(); }
+    const uint64_t *words() const { return d_words.data(); }
+    size_t n_words() const { return d_words.size(); }
+    void to_bytes(unsigned char *data) const;
+    vector_int to_vector_int() const;
+
+    bool operator==(const bitstream_t &other) const { return d_size == other.d_size && d_words == other.d_words; }
+    bool operator!=(const bitstream_t &other) const { return !(*this == other); }
+
+    static size_t n_words_for(size_t n_bits) { return (n_bits + WORD_BITS - 1) / WORD_BITS; }
+    static uint64_t low_bits_mask(int n) { return n >= WORD_BITS ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1; }
+
+private:
+    std::vector<uint64_t> d_words;
+    size_t d_size;
+};
+
+void set_field(bitstream_t &bitstream, int bit_offset, int bit_width, unsigned long new_value);
+unsigned long get_field(const bitstream_t &bitstream, int bit_offset, int bit_width);
+
+} /* namespace light_plc */
+
+#endif /* _LIGHT_PLC_BITSTREAM */
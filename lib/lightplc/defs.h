@@ -64,6 +64,11 @@ enum channel_est_t {
     CE_PREAMBLE = 2
 };
 
+enum turbo_decoder_t {
+    TD_ITPP = 0,
+    TD_NATIVE = 1
+};
+
 typedef std::vector<int> vector_int;
 typedef std::vector<float> vector_float;
 typedef std::complex<float> complex;
@@ -25,6 +25,12 @@
 #include <numeric>
 #include <itpp/comm/modulator.h>
 #include <queue>
+#include <map>
+#include <cstdlib>
+#include <limits>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace light_plc {
 
@@ -68,11 +74,15 @@ const complex phy_service::ANGLE_NUMBER_TO_VALUE[16] = {complex(1.00000000000000
                                                     };
 
 std::mutex phy_service::fftw_mtx;
+std::string phy_service::fftw_wisdom_file;
 
 phy_service::phy_service (tone_mask_t tone_mask, tone_mask_t broadcast_tone_mask, sync_tone_mask_t sync_tone_mask, channel_est_t channel_est, bool debug) {
     static_assert(MT_BPSK==1 && MT_QPSK==2 && MT_QAM8==3 && MT_QAM16==4 && MT_QAM64==5 && MT_QAM256==6 && MT_QAM1024==7 && MT_QAM4096==8, "Mapping parameters error");
     stats = stats_t();
     create_fftw_vars();
+    d_turbo_decoder = TD_ITPP;
+    d_turbo_iterations = TURBO_DEFAULT_ITERATIONS;
+    d_decoder_threads = 1;
     init_turbo_codec();
     d_debug = debug;
     TONE_MASK = tone_mask;
@@ -89,11 +99,8 @@ phy_service::phy_service (tone_mask_t tone_mask, tone_mask_t broadcast_tone_mask
     DEBUG_VAR(N_SYNC_ACTIVE_TONES);
     BROADCAST_QPSK_TONE_INFO = build_broadcast_tone_info();
     DEBUG_VAR(BROADCAST_QPSK_TONE_INFO.capacity);
-    TONE_INFO_STD_ROBO = calc_robo_tone_info(TM_STD_ROBO);
-    TONE_INFO_MINI_ROBO = calc_robo_tone_info(TM_MINI_ROBO);
-    TONE_INFO_HS_ROBO = calc_robo_tone_info(TM_HS_ROBO);
-    calc_preamble(PREAMBLE, SYNCP_FREQ);
-    TURBO_INTERLEAVER_SEQUENCE = calc_turbo_interleaver_sequence();
+    SYNC_TABLES = shared_sync_tables();
+    ROBO_TABLES = shared_robo_tables();
     d_channel_est_mode = channel_est;
     DEBUG_VAR(d_channel_est_mode);
     d_custom_tone_info = build_broadcast_tone_info();
@@ -101,6 +108,10 @@ phy_service::phy_service (tone_mask_t tone_mask, tone_mask_t broadcast_tone_mask
     d_channel_response.n_carriers = N_BROADCAST_TONES;
     d_channel_response.carriers.fill(complex(1, 0));
     d_noise_psd.fill(0);
+    d_rx_params = rx_params_t();
+    reset_payload_decoder();
+    d_tx = tx_state_t();
+    d_tx.segment_index = 1; // nothing prepared, as if the frame control was the last segment
 }
 
 phy_service::phy_service (bool debug): phy_service({IEEE1901_DEFAULT_TONE_MASK}, {IEEE1901_DEFAULT_TONE_MASK}, {IEEE1901_SYNCP_TONE_MASK}, CE_SOUND, debug){};
@@ -114,12 +125,8 @@ phy_service::phy_service (const phy_service &obj) :
     N_SYNC_ACTIVE_TONES(obj.N_SYNC_ACTIVE_TONES),
     SYNC_TONE_MASK_EXPANDED(obj.SYNC_TONE_MASK_EXPANDED),
     BROADCAST_QPSK_TONE_INFO(obj.BROADCAST_QPSK_TONE_INFO),
-    TONE_INFO_STD_ROBO(obj.TONE_INFO_STD_ROBO),
-    TONE_INFO_MINI_ROBO(obj.TONE_INFO_MINI_ROBO),
-    TONE_INFO_HS_ROBO(obj.TONE_INFO_HS_ROBO),
-    PREAMBLE(obj.PREAMBLE),
-    SYNCP_FREQ(obj.SYNCP_FREQ),
-    TURBO_INTERLEAVER_SEQUENCE(obj.TURBO_INTERLEAVER_SEQUENCE),
+    SYNC_TABLES(obj.SYNC_TABLES),
+    ROBO_TABLES(obj.ROBO_TABLES),
     stats(obj.stats),
     d_channel_est_mode(obj.d_channel_est_mode),
     d_custom_tone_info(obj.d_custom_tone_info),
@@ -129,7 +136,17 @@ phy_service::phy_service (const phy_service &obj) :
     d_rx_params(obj.d_rx_params),
     d_rx_payload_symbols_freq(obj.d_rx_payload_symbols_freq),
     d_rx_soft_bits(obj.d_rx_soft_bits),
-    d_rx_mpdu_payload(obj.d_rx_mpdu_payload)
+    d_rx_mpdu_payload(obj.d_rx_mpdu_payload),
+    d_rx_equalizer(obj.d_rx_equalizer),
+    d_rx_equalizer_ready(obj.d_rx_equalizer_ready),
+    d_rx_n_symbols_received(obj.d_rx_n_symbols_received),
+    d_rx_n_symbols_demodulated(obj.d_rx_n_symbols_demodulated),
+    d_rx_n_blocks_decoded(obj.d_rx_n_blocks_decoded),
+    d_tx(obj.d_tx),
+    d_turbo_decoder(obj.d_turbo_decoder),
+    d_turbo_iterations(obj.d_turbo_iterations),
+    d_decoder_threads(obj.d_decoder_threads),
+    d_decoder_pool(obj.d_decoder_pool)
 {
     create_fftw_vars();
     init_turbo_codec();
@@ -145,12 +162,8 @@ phy_service& phy_service::operator=(const phy_service& rhs) {
     std::swap(N_SYNC_ACTIVE_TONES, tmp.N_SYNC_ACTIVE_TONES);
     std::swap(SYNC_TONE_MASK_EXPANDED, tmp.SYNC_TONE_MASK_EXPANDED);
     std::swap(BROADCAST_QPSK_TONE_INFO, tmp.BROADCAST_QPSK_TONE_INFO);
-    std::swap(TONE_INFO_STD_ROBO, tmp.TONE_INFO_STD_ROBO);
-    std::swap(TONE_INFO_MINI_ROBO, tmp.TONE_INFO_MINI_ROBO);
-    std::swap(TONE_INFO_HS_ROBO, tmp.TONE_INFO_HS_ROBO);
-    std::swap(PREAMBLE, tmp.PREAMBLE);
-    std::swap(SYNCP_FREQ, tmp.SYNCP_FREQ);
-    std::swap(TURBO_INTERLEAVER_SEQUENCE, tmp.TURBO_INTERLEAVER_SEQUENCE);
+    std::swap(SYNC_TABLES, tmp.SYNC_TABLES);
+    std::swap(ROBO_TABLES, tmp.ROBO_TABLES);
     std::swap(d_channel_est_mode, tmp.d_channel_est_mode);
     std::swap(d_custom_tone_info, tmp.d_custom_tone_info);
     std::swap(d_qpsk_tone_mask, tmp.d_qpsk_tone_mask);
@@ -161,92 +174,202 @@ phy_service& phy_service::operator=(const phy_service& rhs) {
     std::swap(d_rx_payload_symbols_freq, tmp.d_rx_payload_symbols_freq);
     std::swap(d_rx_soft_bits, tmp.d_rx_soft_bits);
     std::swap(d_rx_mpdu_payload, tmp.d_rx_mpdu_payload);
+    std::swap(d_rx_equalizer, tmp.d_rx_equalizer);
+    std::swap(d_rx_equalizer_ready, tmp.d_rx_equalizer_ready);
+    std::swap(d_rx_n_symbols_received, tmp.d_rx_n_symbols_received);
+    std::swap(d_rx_n_symbols_demodulated, tmp.d_rx_n_symbols_demodulated);
+    std::swap(d_rx_n_blocks_decoded, tmp.d_rx_n_blocks_decoded);
+    std::swap(d_tx, tmp.d_tx);
+    std::swap(d_rx_workspace, tmp.d_rx_workspace);
     std::swap(d_ifft_input, tmp.d_ifft_input);
     std::swap(d_ifft_output, tmp.d_ifft_output);
-    std::swap(d_fftw_rev_plan, tmp.d_fftw_rev_plan);
     std::swap(d_fft_input, tmp.d_fft_input);
     std::swap(d_fft_output, tmp.d_fft_output);
-    std::swap(d_fftw_fwd_plan, tmp.d_fftw_fwd_plan);
+    std::swap(d_ifft_batch_input, tmp.d_ifft_batch_input);
+    std::swap(d_ifft_batch_output, tmp.d_ifft_batch_output);
+    std::swap(d_fft_batch_input, tmp.d_fft_batch_input);
+    std::swap(d_fft_batch_output, tmp.d_fft_batch_output);
+    std::swap(d_ifft_syncp_input, tmp.d_ifft_syncp_input);
+    std::swap(d_ifft_syncp_output, tmp.d_ifft_syncp_output);
     std::swap(d_fft_syncp_input, tmp.d_fft_syncp_input);
     std::swap(d_fft_syncp_output, tmp.d_fft_syncp_output);
-    std::swap(d_fftw_syncp_fwd_plan, tmp.d_fftw_syncp_fwd_plan);
+    std::swap(d_turbo_decoder, tmp.d_turbo_decoder);
+    std::swap(d_turbo_iterations, tmp.d_turbo_iterations);
+    std::swap(d_turbo_codecs, tmp.d_turbo_codecs);
+    std::swap(d_native_turbo_codecs, tmp.d_native_turbo_codecs);
+    std::swap(d_decoder_threads, tmp.d_decoder_threads);
+    std::swap(d_decoder_pool, tmp.d_decoder_pool);
+    init_turbo_codec();
     return *this;
 }
 
 phy_service::~phy_service (void){
     fftwf_free(d_ifft_input);
     fftwf_free(d_ifft_output);
-    fftwf_destroy_plan(d_fftw_rev_plan);
     fftwf_free(d_fft_input);
     fftwf_free(d_fft_output);
-    fftwf_destroy_plan(d_fftw_fwd_plan);
+    fftwf_free(d_ifft_batch_input);
+    fftwf_free(d_ifft_batch_output);
+    fftwf_free(d_fft_batch_input);
+    fftwf_free(d_fft_batch_output);
+    fftwf_free(d_ifft_syncp_input);
+    fftwf_free(d_ifft_syncp_output);
     fftwf_free(d_fft_syncp_input);
     fftwf_free(d_fft_syncp_output);
-    fftwf_destroy_plan(d_fftw_syncp_fwd_plan);
 }
 
 vector_complex phy_service::create_ppdu(const unsigned char *mpdu_fc_bin, size_t mpdu_fc_len, const unsigned char *mpdu_payload_bin, size_t mpdu_payload_len) {
-    vector_int mpdu_payload_int(unpack_into_bitvector(mpdu_payload_bin, mpdu_payload_len));
-    vector_int mpdu_fc_int(unpack_into_bitvector(mpdu_fc_bin, mpdu_fc_len));
-    return create_ppdu(mpdu_fc_int, mpdu_payload_int);
+    bitstream_t mpdu_fc(mpdu_fc_bin, mpdu_fc_len);
+    bitstream_t mpdu_payload(mpdu_payload_bin, mpdu_payload_len);
+    return create_ppdu(mpdu_fc, mpdu_payload);
 }
 
 vector_complex phy_service::create_ppdu(vector_int &mpdu_fc_int, const vector_int &mpdu_payload_int) {
-    assert(mpdu_fc_int.size() == FRAME_CONTROL_NBITS);
-    tx_params_t tx_params = get_tx_params(mpdu_fc_int);
-    update_frame_control(mpdu_fc_int, tx_params, mpdu_payload_int.size());
+    bitstream_t mpdu_fc(mpdu_fc_int);
+    vector_complex datastream = create_ppdu(mpdu_fc, bitstream_t(mpdu_payload_int));
+    mpdu_fc_int = mpdu_fc.to_vector_int(); // frame length and FCCS are updated
+    return datastream;
+}
 
-    // Encode frame control
-    DEBUG_ECHO("Encoding frame control...")
-    DEBUG_VECTOR(mpdu_fc_int);
-    vector_complex fc_symbols = create_frame_control_symbol(mpdu_fc_int);
-
-    // Encode payload blocks
-    vector_complex payload_symbols;
-    if (mpdu_payload_int.size()) {
-        DEBUG_ECHO("Encoding payload blocks...")
-        DEBUG_VECTOR(mpdu_payload_int);
-        payload_symbols = create_payload_symbols(mpdu_payload_int, tx_params.pb_size, tx_params.tone_mode);
-    }
+vector_complex phy_service::create_ppdu(bitstream_t &mpdu_fc, const bitstream_t &mpdu_payload) {
+    size_t length = prepare_ppdu(mpdu_fc, mpdu_payload);
 
     DEBUG_ECHO("Creating final data stream...")
+    vector_complex datastream(length);
+    generate_ppdu(datastream.data(), length);
+
+    DEBUG_VECTOR(datastream);
+    return datastream;
+}
+
+size_t phy_service::prepare_ppdu(const unsigned char *mpdu_fc_bin, size_t mpdu_fc_len, const unsigned char *mpdu_payload_bin, size_t mpdu_payload_len) {
+    return prepare_ppdu(d_tx, mpdu_fc_bin, mpdu_fc_len, mpdu_payload_bin, mpdu_payload_len);
+}
 
-    // Calculate final size
-    vector_complex datastream(
-        PREAMBLE.size() - ROLLOFF_INTERVAL + // Premable size
-        NUMBER_OF_CARRIERS + IEEE1901_GUARD_INTERVAL_FC  + // frame control size
-        payload_symbols.size() / NUMBER_OF_CARRIERS * (NUMBER_OF_CARRIERS + IEEE1901_GUARD_INTERVAL_PAYLOAD) + ROLLOFF_INTERVAL // payload size
-    );
+size_t phy_service::prepare_ppdu(bitstream_t &mpdu_fc, const bitstream_t &mpdu_payload) {
+    return prepare_ppdu(d_tx, mpdu_fc, mpdu_payload);
+}
 
-    // Append preamble, frame control and payload to the datastream
-    vector_complex::iterator datastream_iter = datastream.begin();
-    datastream_iter = append_datastream(PREAMBLE.begin(), PREAMBLE.end(), datastream_iter, 0, IEEE1901_SCALE_FACTOR_PREAMBLE);
+size_t phy_service::generate_ppdu(complex *out, size_t n_samples) {
+    return generate_ppdu(d_tx, out, n_samples);
+}
+
+size_t phy_service::prepare_ppdu(tx_state_t &ppdu, const unsigned char *mpdu_fc_bin, size_t mpdu_fc_len, const unsigned char *mpdu_payload_bin, size_t mpdu_payload_len) {
+    bitstream_t mpdu_fc(mpdu_fc_bin, mpdu_fc_len);
+    bitstream_t mpdu_payload(mpdu_payload_bin, mpdu_payload_len);
+    return prepare_ppdu(ppdu, mpdu_fc, mpdu_payload);
+}
+
+size_t phy_service::prepare_ppdu(tx_state_t &ppdu, bitstream_t &mpdu_fc, const bitstream_t &mpdu_payload) {
+    assert(mpdu_fc.size() == FRAME_CONTROL_NBITS);
+    ppdu.params = get_tx_params(mpdu_fc);
+    update_frame_control(mpdu_fc, ppdu.params, mpdu_payload.size());
+    ppdu.mpdu_fc = mpdu_fc;
+
+    // Encode payload blocks. The symbols are modulated only when generate_ppdu() gets to them
+    ppdu.tone_info = get_tone_info(ppdu.params.tone_mode);
+    ppdu.encoded_payload = bitstream_t();
+    ppdu.n_symbols = 0;
+    if (mpdu_payload.size()) {
+        DEBUG_ECHO("Encoding payload blocks...")
+        DEBUG_VECTOR(mpdu_payload);
+        ppdu.encoded_payload = encode_payload(mpdu_payload, ppdu.params.pb_size, ppdu.tone_info.rate, ppdu.params.tone_mode);
+        ppdu.n_symbols = (ppdu.encoded_payload.size() + ppdu.tone_info.capacity - 1) / ppdu.tone_info.capacity;
+    }
+    ppdu.bit_pos = 0;
+    ppdu.pn_step = 0;
+    ppdu.symbols_freq = vector_complex(ppdu.n_symbols ? NUMBER_OF_CARRIERS * FFT_BATCH_SIZE : 0);
+    ppdu.symbols = vector_complex(ppdu.symbols_freq.size());
+    ppdu.batch_offset = 0;
+    ppdu.batch_size = 0;
+
+    // Start with the preamble
+    ppdu.segment_index = -1;
+    next_ppdu_segment(ppdu);
+
+    ppdu.length = SYNC_TABLES->preamble.size() - ROLLOFF_INTERVAL + // Premable size
+        FRAME_CONTROL_SIZE + // frame control size
+        ppdu.n_symbols * PAYLOAD_SYMBOL_SIZE + ROLLOFF_INTERVAL; // payload size
+    return ppdu.length;
+}
+
+size_t phy_service::generate_ppdu(tx_state_t &ppdu, complex *out, size_t n_samples) {
+    size_t n = 0;
+    while (n < n_samples) {
+        // The falling window at the end of a segment is output once the next segment is added to it
+        bool last = (ppdu.segment_index == (int)ppdu.n_symbols + 1);
+        size_t ready = last ? ppdu.segment.size() : ppdu.segment.size() - ROLLOFF_INTERVAL;
+        if (ppdu.segment_offset == ready) {
+            if (last)
+                break;
+            next_ppdu_segment(ppdu);
+            continue;
+        }
+        size_t count = std::min(n_samples - n, ready - ppdu.segment_offset);
+        std::copy(ppdu.segment.begin() + ppdu.segment_offset, ppdu.segment.begin() + ppdu.segment_offset + count, out + n);
+        ppdu.segment_offset += count;
+        n += count;
+    }
+    return n;
+}
+
+void phy_service::next_ppdu_segment(tx_state_t &ppdu) {
+    ppdu.segment_index++;
+    ppdu.segment_offset = 0;
+    if (ppdu.segment_index == 0) {
+        const vector_complex &preamble = SYNC_TABLES->preamble;
+        ppdu.segment = vector_complex(preamble.size());
+        append_datastream(preamble.begin(), preamble.end(), ppdu.segment.begin(), 0, IEEE1901_SCALE_FACTOR_PREAMBLE);
+        return;
+    }
 
     // Frame control and payload scale factor is divided by N to compensate for the ifft which implicitly multiply by N
-    datastream_iter = append_datastream(fc_symbols.begin(), fc_symbols.begin() + NUMBER_OF_CARRIERS, datastream_iter - ROLLOFF_INTERVAL, IEEE1901_GUARD_INTERVAL_FC + ROLLOFF_INTERVAL, IEEE1901_SCALE_FACTOR_FC / NUMBER_OF_CARRIERS);
-    vector_complex::const_iterator payload_symbols_iter = payload_symbols.begin();
-    while (payload_symbols_iter != payload_symbols.end()) {
-        datastream_iter = append_datastream(payload_symbols_iter, payload_symbols_iter + NUMBER_OF_CARRIERS, datastream_iter - ROLLOFF_INTERVAL, IEEE1901_GUARD_INTERVAL_PAYLOAD + ROLLOFF_INTERVAL, IEEE1901_SCALE_FACTOR_PAYLOAD / NUMBER_OF_CARRIERS);
-        payload_symbols_iter += NUMBER_OF_CARRIERS;
+    vector_complex fc_symbol;
+    vector_complex::const_iterator symbol_iter;
+    size_t cp_length;
+    float gain;
+    if (ppdu.segment_index == 1) {
+        DEBUG_ECHO("Encoding frame control...")
+        DEBUG_VECTOR(ppdu.mpdu_fc);
+        fc_symbol = create_frame_control_symbol(ppdu.mpdu_fc);
+        symbol_iter = fc_symbol.begin();
+        cp_length = IEEE1901_GUARD_INTERVAL_FC + ROLLOFF_INTERVAL;
+        gain = IEEE1901_SCALE_FACTOR_FC / NUMBER_OF_CARRIERS;
+    } else {
+        if (ppdu.batch_offset == ppdu.batch_size) {
+            // Mapping and IFFT of the next batch of payload symbols, the carriers are written in FFT order
+            ppdu.batch_size = std::min((size_t)FFT_BATCH_SIZE, ppdu.n_symbols - (ppdu.segment_index - 2));
+            for (size_t j = 0; j < ppdu.batch_size; j++)
+                modulate_symbol(ppdu.encoded_payload, ppdu.bit_pos, ppdu.pn_step, ppdu.tone_info, ppdu.symbols_freq.data() + j * NUMBER_OF_CARRIERS, true);
+            ifft_symbols(ppdu.symbols_freq.data(), ppdu.symbols.data(), ppdu.batch_size);
+            ppdu.batch_offset = 0;
+        }
+        symbol_iter = ppdu.symbols.begin() + ppdu.batch_offset * NUMBER_OF_CARRIERS;
+        ppdu.batch_offset++;
+        cp_length = IEEE1901_GUARD_INTERVAL_PAYLOAD + ROLLOFF_INTERVAL;
+        gain = IEEE1901_SCALE_FACTOR_PAYLOAD / NUMBER_OF_CARRIERS;
     }
 
-    DEBUG_VECTOR(datastream);
-    return datastream;
+    // The rising window of the new symbol is added to the falling window of the previous one
+    ppdu.next_segment.resize(cp_length + NUMBER_OF_CARRIERS);
+    std::copy(ppdu.segment.end() - ROLLOFF_INTERVAL, ppdu.segment.end(), ppdu.next_segment.begin());
+    append_datastream(symbol_iter, symbol_iter + NUMBER_OF_CARRIERS, ppdu.next_segment.begin(), cp_length, gain);
+    std::swap(ppdu.segment, ppdu.next_segment);
 }
 
-phy_service::tx_params_t phy_service::get_tx_params (const vector_int &mpdu_fc_int) {
+phy_service::tx_params_t phy_service::get_tx_params (const bitstream_t &mpdu_fc) {
     tx_params_t tx_params;
-    delimiter_type_t dt = (delimiter_type_t)get_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_DT_IH_OFFSET, IEEE1901_FRAME_CONTROL_DT_IH_WIDTH);
+    delimiter_type_t dt = (delimiter_type_t)get_field(mpdu_fc, IEEE1901_FRAME_CONTROL_DT_IH_OFFSET, IEEE1901_FRAME_CONTROL_DT_IH_WIDTH);
     switch (dt) {
         case DT_SOF: {
-            int tmi = get_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_SOF_TMI_OFFSET, IEEE1901_FRAME_CONTROL_SOF_TMI_WIDTH);
+            int tmi = get_field(mpdu_fc, IEEE1901_FRAME_CONTROL_SOF_TMI_OFFSET, IEEE1901_FRAME_CONTROL_SOF_TMI_WIDTH);
             switch (tmi) {
                 case 0: tx_params.tone_mode = TM_STD_ROBO; break;
                 case 1: tx_params.tone_mode = TM_HS_ROBO; break;
                 case 2: tx_params.tone_mode = TM_MINI_ROBO; break;
                 default: tx_params.tone_mode = TM_NO_ROBO; break;
             }
-            int pbsz = get_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_SOF_PBSZ_OFFSET, IEEE1901_FRAME_CONTROL_SOF_PBSZ_WIDTH);
+            int pbsz = get_field(mpdu_fc, IEEE1901_FRAME_CONTROL_SOF_PBSZ_OFFSET, IEEE1901_FRAME_CONTROL_SOF_PBSZ_WIDTH);
             switch (pbsz) {
                 case 0: tx_params.pb_size = PB520; break;
                 case 1: tx_params.pb_size = PB136; break;
@@ -254,7 +377,7 @@ phy_service::tx_params_t phy_service::get_tx_params (const vector_int &mpdu_fc_i
             break;
         }
         case DT_SOUND: {
-            int pbsz = get_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_SOUND_PBSZ_OFFSET, IEEE1901_FRAME_CONTROL_SOUND_PBSZ_WIDTH);
+            int pbsz = get_field(mpdu_fc, IEEE1901_FRAME_CONTROL_SOUND_PBSZ_OFFSET, IEEE1901_FRAME_CONTROL_SOUND_PBSZ_WIDTH);
             switch (pbsz) {
                 case 0: tx_params.pb_size = PB520; tx_params.tone_mode = TM_STD_ROBO; break;
                 case 1: tx_params.pb_size = PB136; tx_params.tone_mode = TM_MINI_ROBO; break;
@@ -270,12 +393,12 @@ phy_service::tx_params_t phy_service::get_tx_params (const vector_int &mpdu_fc_i
     return tx_params;
 }
 
-void phy_service::update_frame_control (vector_int &mpdu_fc_int, tx_params_t tx_params, size_t payload_size) {
-    delimiter_type_t dt = (delimiter_type_t)get_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_DT_IH_OFFSET, IEEE1901_FRAME_CONTROL_DT_IH_WIDTH);
+void phy_service::update_frame_control (bitstream_t &mpdu_fc, tx_params_t tx_params, size_t payload_size) {
+    delimiter_type_t dt = (delimiter_type_t)get_field(mpdu_fc, IEEE1901_FRAME_CONTROL_DT_IH_OFFSET, IEEE1901_FRAME_CONTROL_DT_IH_WIDTH);
     int fl_width = 0;
     if (dt == DT_SOF || dt == DT_SOUND) {
         // Calculate frame length
-        tone_info_t tone_info = get_tone_info(tx_params.tone_mode);
+        const tone_info_t &tone_info = get_tone_info(tx_params.tone_mode);
         int n_blocks = payload_size / calc_phy_block_size(tx_params.pb_size);
         int fec_block_size = calc_fec_block_size(tx_params.tone_mode, tone_info.rate, tx_params.pb_size);
         int n_bits = n_blocks * fec_block_size;
@@ -285,51 +408,25 @@ void phy_service::update_frame_control (vector_int &mpdu_fc_int, tx_params_t tx_
     }
     switch (dt) {
         case DT_SOF:
-            set_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_SOF_FL_OFFSET, IEEE1901_FRAME_CONTROL_SOF_FL_WIDTH, fl_width);
+            set_field(mpdu_fc, IEEE1901_FRAME_CONTROL_SOF_FL_OFFSET, IEEE1901_FRAME_CONTROL_SOF_FL_WIDTH, fl_width);
             break;
         case DT_SOUND:
-            set_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_SOUND_FL_OFFSET, IEEE1901_FRAME_CONTROL_SOUND_FL_WIDTH, fl_width);
+            set_field(mpdu_fc, IEEE1901_FRAME_CONTROL_SOUND_FL_OFFSET, IEEE1901_FRAME_CONTROL_SOUND_FL_WIDTH, fl_width);
             break;
         default:
             break;
     }
 
     // Calculate and set CRC24
-    unsigned long crc = crc24(vector_int(mpdu_fc_int.begin(),mpdu_fc_int.end()-24));
-    set_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_FCCS_OFFSET + 16, 8, crc & 0xFF);
-    set_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_FCCS_OFFSET + 8, 8, (crc >> 8) & 0xFF);
-    set_field(mpdu_fc_int, IEEE1901_FRAME_CONTROL_FCCS_OFFSET, 8, (crc >> 16) & 0xFF);
+    unsigned long crc = crc24(mpdu_fc, mpdu_fc.size() - 24);
+    set_field(mpdu_fc, IEEE1901_FRAME_CONTROL_FCCS_OFFSET + 16, 8, crc & 0xFF);
+    set_field(mpdu_fc, IEEE1901_FRAME_CONTROL_FCCS_OFFSET + 8, 8, (crc >> 8) & 0xFF);
+    set_field(mpdu_fc, IEEE1901_FRAME_CONTROL_FCCS_OFFSET, 8, (crc >> 16) & 0xFF);
 
     return;
 }
 
-void phy_service::pack_bitvector(vector_int::const_iterator iter, vector_int::const_iterator end, unsigned char* array) {
-    assert ((end-iter) % 8 == 0);
-    int i = 0;
-    while (iter!=end) {
-        unsigned char byte = 0;
-        for (int offset=0; offset<8; offset++)
-            byte |= *iter++ << offset;
-        array[i++] = byte;
-    }
-}
-
-vector_int phy_service::unpack_into_bitvector (const unsigned char *data, size_t c) {
-    vector_int bit_vector(c*8, 0);
-    for (unsigned int i=0; i<c; i++)
-    {
-        unsigned char byte = data[i];
-        int offset = 0;
-        while (byte)
-        {
-            bit_vector[i*8+offset++] = byte & 1;
-            byte >>= 1;
-        }
-    }
-    return bit_vector;
-}
-
-unsigned long phy_service::crc24(const vector_int &bit_vector) {
+unsigned long phy_service::crc24(const bitstream_t &bitstream, size_t n_bits) {
     //800FE3
 
     //crc24 table for polynom=800063
@@ -369,21 +466,17 @@ unsigned long phy_service::crc24(const vector_int &bit_vector) {
     };
 
     unsigned long crc = -1; // init value to all ones
-    vector_int::const_iterator iter = bit_vector.begin();
-    assert (bit_vector.size() % 8 == 0);
-
-    while(iter != bit_vector.end()) {
-        unsigned char cp;
-        cp = 0;
-        for (int offset=0; offset<8; offset++)
-            cp |= (*iter++) << offset;
+    assert (n_bits % 8 == 0 && n_bits <= bitstream.size());
+
+    for (size_t i = 0; i < n_bits; i += 8) {
+        unsigned char cp = bitstream.get_bits(i, 8);
         crc = ((crc << 8) & 0xffff00) ^ crc24tab[((crc >> 16) & 0xff) ^ cp];
     }
 
     return (crc ^ 0xffffff);
 }
 
-vector_int phy_service::encode_payload(const vector_int &payload_bits, pb_size_t pb_size, code_rate_t rate, tone_mode_t tone_mode) {
+bitstream_t phy_service::encode_payload(const bitstream_t &payload_bits, pb_size_t pb_size, code_rate_t rate, tone_mode_t tone_mode) {
     // Determine number of blocks and blocks size
     int block_n_bits = (pb_size == PB520) ? 520*8 : 136*8;
     assert (pb_size == PB520 || pb_size == PB136); // Cannot have payload blocks of 16 octets
@@ -392,23 +485,24 @@ vector_int phy_service::encode_payload(const vector_int &payload_bits, pb_size_t
     assert ((payload_bits.size() % block_n_bits) == 0);
 
     int block_size = calc_fec_block_size(tone_mode, rate, pb_size);
-    // Encode blocks
-    vector_int block_bits, encoded_payload_bits(block_size * n_blocks);
-    vector_int::iterator iter_out = encoded_payload_bits.begin();
-    int scrambler_state = scrambler_init(); // This inits the scrambler state
-    vector_int::const_iterator iter_in = payload_bits.begin();
-    while (iter_in != payload_bits.end()) {
-        block_bits = vector_int(iter_in, iter_in + block_n_bits);
+    // Encode blocks. The only link between blocks is the scrambler state, which is jumped ahead to
+    // the start of each block, so the blocks are encoded in parallel
+    std::vector<bitstream_t> encoded_blocks(n_blocks);
+    std::function<void(size_t)> encode_block = [&](size_t i) {
+        size_t block_start = i * block_n_bits;
+        bitstream_t block_bits;
+        block_bits.append(payload_bits, block_start, block_start + block_n_bits);
         // Scrambler
-        vector_int scrambled = scrambler(block_bits, scrambler_state);
+        int scrambler_state = scrambler_jump(scrambler_init(), block_start);
+        bitstream_t scrambled = scrambler(block_bits, scrambler_state);
         DEBUG_VECTOR(scrambled);
 
         // Turbo-convolution encoder
-        vector_int parity = tc_encoder(scrambled, pb_size, rate);
+        bitstream_t parity = tc_encoder(scrambled, pb_size, rate);
         DEBUG_VECTOR(parity);
 
         // Channel interleaver
-        vector_int interleaved = channel_interleaver(scrambled, parity, pb_size, rate);
+        bitstream_t interleaved = channel_interleaver(scrambled, parity, pb_size, rate);
         DEBUG_VECTOR(interleaved);
 
         if (tone_mode == TM_STD_ROBO || tone_mode == TM_MINI_ROBO || tone_mode == TM_HS_ROBO) {
@@ -416,38 +510,24 @@ vector_int phy_service::encode_payload(const vector_int &payload_bits, pb_size_t
             DEBUG_VECTOR(interleaved);
         }
 
-        iter_out = std::copy(interleaved.begin(), interleaved.end(), iter_out);
-        iter_in += block_n_bits;
-    }
-    return encoded_payload_bits;
-}
-
-vector_complex phy_service::create_payload_symbols(const vector_int &payload_bits, pb_size_t pb_size, tone_mode_t tone_mode) {
-    tone_info_t tone_info = get_tone_info(tone_mode);
-
-    // Encode and interleave
-    vector_int encoded_payload_bits = encode_payload(payload_bits, pb_size, tone_info.rate, tone_mode);
-
-    // Mapping and split to symbols
-    vector_complex symbols_freq = modulate(encoded_payload_bits, tone_info);
-
-    // Perform IFFT to get a time domain symbol
-    vector_complex::const_iterator symbols_freq_iter = symbols_freq.begin();
-    vector_complex symbols(symbols_freq.size());
-    vector_complex::iterator symbols_iter = symbols.begin();
-    while (symbols_freq_iter != symbols_freq.end()) {
-        symbols_iter = ifft(symbols_freq_iter, symbols_freq_iter + NUMBER_OF_CARRIERS, symbols_iter);
-        symbols_freq_iter += NUMBER_OF_CARRIERS;
-        DEBUG_VECTOR_RANGE("symbols_freq", symbols_freq_iter - NUMBER_OF_CARRIERS, symbols_freq_iter);
-        DEBUG_VECTOR_RANGE("symbols", symbols_iter - NUMBER_OF_CARRIERS , symbols_iter);
-    }
+        encoded_blocks[i] = std::move(interleaved);
+    };
+    if (d_debug) { // keep the debug output in order
+        for (int i = 0; i < n_blocks; i++)
+            encode_block(i);
+    } else
+        thread_pool::shared().parallel_for(n_blocks, encode_block);
 
-    return symbols;
+    bitstream_t encoded_payload_bits;
+    encoded_payload_bits.reserve(block_size * n_blocks);
+    for (int i = 0; i < n_blocks; i++)
+        encoded_payload_bits.append(encoded_blocks[i]);
+    return encoded_payload_bits;
 }
 
-vector_complex phy_service::create_frame_control_symbol(const vector_int &frame_control_bits) {
+vector_complex phy_service::create_frame_control_symbol(const bitstream_t &frame_control_bits) {
     // Encode frame control
-    vector_int encoded_frame_control = encode_frame_control(frame_control_bits);
+    bitstream_t encoded_frame_control = encode_frame_control(frame_control_bits);
 
     // Mapping and split to symbols
     vector_complex frame_control_symbol_freq = modulate(encoded_frame_control, BROADCAST_QPSK_TONE_INFO);
@@ -461,73 +541,121 @@ vector_complex phy_service::create_frame_control_symbol(const vector_int &frame_
     return frame_control_symbol;
 }
 
-vector_int phy_service::encode_frame_control(const vector_int &frame_control_bits) {
+bitstream_t phy_service::encode_frame_control(const bitstream_t &frame_control_bits) {
     // Turbo-convolution encoder
-    vector_int parity = tc_encoder(frame_control_bits, PB16, RATE_1_2);
+    bitstream_t parity = tc_encoder(frame_control_bits, PB16, RATE_1_2);
     DEBUG_VECTOR(parity);
 
     // Channel interleaver
-    vector_int interleaved = channel_interleaver(frame_control_bits, parity, PB16, RATE_1_2);
+    bitstream_t interleaved = channel_interleaver(frame_control_bits, parity, PB16, RATE_1_2);
     DEBUG_VECTOR(interleaved);
 
-    vector_int copied = copier(interleaved, N_BROADCAST_TONES, 128 + 12/2); // +12/2 because of non-standard turbo encoder...
+    bitstream_t copied = copier(interleaved, N_BROADCAST_TONES, 128 + 12/2); // +12/2 because of non-standard turbo encoder...
     DEBUG_VECTOR(copied);
 
     return copied;
 }
 
-vector_int phy_service::scrambler(const vector_int& bitstream, int &state) {
+bitstream_t phy_service::scrambler(const bitstream_t& bitstream, int &state) {
+    bitstream_t out;
+    scrambler(bitstream, state, out);
+    return out;
+}
+
+void phy_service::scrambler(const bitstream_t& bitstream, int &state, bitstream_t &out) {
     int feedback;
-    vector_int out(bitstream.size());
-    for (unsigned int i = 0; i < bitstream.size(); i++) {
-        feedback = (!!(state & 0x200)) ^ (!!(state & 0x4)); // feedback = state[2] XOR state[9]
-        out[i] = feedback ^ bitstream[i];
-        state = ((state << 1) & 0x3FF) | feedback;
+    out.resize(bitstream.size());
+    // Run the LFSR a word at a time and XOR the whole word
+    for (size_t w = 0; w < bitstream.n_words(); w++) {
+        int n_bits = std::min<size_t>(bitstream_t::WORD_BITS, bitstream.size() - w * bitstream_t::WORD_BITS);
+        uint64_t sequence = 0;
+        for (int i = 0; i < n_bits; i++) {
+            feedback = (!!(state & 0x200)) ^ (!!(state & 0x4)); // feedback = state[2] XOR state[9]
+            sequence |= (uint64_t)feedback << i;
+            state = ((state << 1) & 0x3FF) | feedback;
+        }
+        out.words()[w] = bitstream.words()[w] ^ sequence;
     }
-    return out;
 }
 
 int phy_service::scrambler_init(void) {
     return 0x3FF;
 }
 
+int phy_service::scrambler_jump(int state, size_t n_bits) {
+    // The scrambler is a linear map over GF(2): column j is the next state of the unit state 1<<j.
+    // Raise it to the power n_bits by squaring and apply it to the state
+    std::array<int, 10> step;
+    for (int j = 0; j < 10; j++) {
+        int unit = 1 << j;
+        int feedback = (!!(unit & 0x200)) ^ (!!(unit & 0x4));
+        step[j] = ((unit << 1) & 0x3FF) | feedback;
+    }
+    auto apply = [](const std::array<int, 10> &map, int s) {
+        int out = 0;
+        for (int j = 0; j < 10; j++)
+            if (s & (1 << j))
+                out ^= map[j];
+        return out;
+    };
+    for (; n_bits; n_bits >>= 1) {
+        if (n_bits & 1)
+            state = apply(step, state);
+        std::array<int, 10> square;
+        for (int j = 0; j < 10; j++)
+            square[j] = apply(step, step[j]);
+        step = square;
+    }
+    return state;
+}
+
 void phy_service::init_turbo_codec() {
     itpp::ivec gen(2);
     gen(0) = 013; gen(1) = 015;
     itpp::bmat puncture_matrix = "1;1;1";
     itpp::ivec interleaver_sequence_bvec;
-    d_turbo_codec.set_parameters(gen, gen, 4, interleaver_sequence_bvec, puncture_matrix, 4, "LOGMAX", 1.0, true, itpp::LLR_calc_unit());
+    d_turbo_codecs.resize(d_decoder_threads);
+    d_native_turbo_codecs.resize(d_decoder_threads);
+    d_rx_workspace.lanes.resize(d_decoder_threads);
+    for (size_t i = 0; i < d_turbo_codecs.size(); i++)
+        d_turbo_codecs[i].set_parameters(gen, gen, 4, interleaver_sequence_bvec, puncture_matrix, d_turbo_iterations, "LOGMAX", 1.0, true, itpp::LLR_calc_unit());
+}
+
+void phy_service::set_turbo_decoder(turbo_decoder_t decoder, int max_iterations) {
+    assert(max_iterations > 0);
+    d_turbo_decoder = decoder;
+    d_turbo_iterations = max_iterations;
+    DEBUG_VAR(d_turbo_decoder);
+    DEBUG_VAR(d_turbo_iterations);
+    init_turbo_codec();
 }
 
-vector_int phy_service::tc_encoder(const vector_int &bitstream, pb_size_t pb_size, code_rate_t rate) {
-    itpp::bmat puncture_matrix;
-    assert (rate == RATE_1_2); // Only Rate = 1/2 is supported in the encoder/decoder
-    if (rate == RATE_1_2)
-        puncture_matrix = "1 1;1 0;0 1";
+void phy_service::set_decoder_threads(unsigned int n_threads) {
+    assert(n_threads > 0);
+    d_decoder_threads = n_threads;
+    // The thread running the decoder takes a lane too, so the pool needs one worker less
+    d_decoder_pool = (n_threads > 1) ? std::make_shared<thread_pool>(n_threads - 1) : std::shared_ptr<thread_pool>();
+    DEBUG_VAR(d_decoder_threads);
+    init_turbo_codec();
+}
 
-    itpp::ivec interleaver_sequence_bvec = to_ivec(TURBO_INTERLEAVER_SEQUENCE[pb_size]);
-    d_turbo_codec.set_interleaver(interleaver_sequence_bvec);
-    d_turbo_codec.set_puncture_matrix(puncture_matrix);
-    itpp::bvec encoded_bvec;
+bitstream_t phy_service::tc_encoder(const bitstream_t &bitstream, pb_size_t pb_size, code_rate_t rate) {
+    assert (rate == RATE_1_2); // Only Rate = 1/2 is supported in the encoder/decoder
 
-    d_turbo_codec.encode(to_bvec(bitstream),encoded_bvec);
-    vector_int encoded = to_vector_int(encoded_bvec);
-    DEBUG_VECTOR(encoded);
+    // Run the table driven encoder on the octets
+    std::vector<unsigned char> info(bitstream.size() / 8);
+    std::vector<unsigned char> parity_packed((bitstream.size() + turbo_codec::N_PARITY_PAD_BITS + 7) / 8);
+    bitstream.to_bytes(info.data());
+    turbo_codec::encode(info.data(), bitstream.size(), turbo_interleaver_sequence()[pb_size], parity_packed.data());
 
-    vector_int parity(((encoded.size()-bitstream.size() + 3) / 4) * 4);  // The parity should be divisible by 4
-    unsigned int i = 0;
-    for (;i < bitstream.size(); i++) {
-        parity[i] = encoded[i*2+1]; // first bit is systematic, second is parity
-    }
-    for (unsigned int j = i*2; j<encoded.size(); j++) {
-        parity[i] = encoded[j];
-        i++;
-    }
+    bitstream_t parity(parity_packed.data(), parity_packed.size());
+    parity.resize(bitstream.size() + turbo_codec::N_PARITY_PAD_BITS);  // The parity should be divisible by 4
+    DEBUG_VECTOR(parity);
 
     return parity;
 }
 
-vector_int phy_service::tc_decoder(const vector_float &received_info, const vector_float &received_parity, pb_size_t pb_size, code_rate_t rate) {
+void phy_service::tc_decoder(const vector_float &received_info, const vector_float &received_parity, pb_size_t pb_size, code_rate_t rate, vector_int &decoded, size_t lane) {
     itpp::bmat puncture_matrix;
     assert (rate == RATE_1_2); // Only Rate = 1/2 is supported in the encoder/decoder
     if (rate == RATE_1_2)
@@ -536,11 +664,20 @@ vector_int phy_service::tc_decoder(const vector_float &received_info, const vect
     DEBUG_VECTOR (received_info);
     DEBUG_VECTOR (received_parity);
 
-    itpp::ivec interleaver_sequence_bvec = to_ivec(TURBO_INTERLEAVER_SEQUENCE[pb_size]);
-    d_turbo_codec.set_interleaver(interleaver_sequence_bvec);
-    d_turbo_codec.set_puncture_matrix(puncture_matrix);
+    if (d_turbo_decoder == TD_NATIVE) {
+        decoded.resize(received_info.size());
+        d_native_turbo_codecs[lane].decode(received_info.data(), received_parity.data(), received_info.size(),
+                                    turbo_interleaver_sequence()[pb_size], d_turbo_iterations, decoded.data());
+        DEBUG_VECTOR(decoded);
+        return;
+    }
+
+    itpp::Punctured_Turbo_Codec &turbo_codec = d_turbo_codecs[lane];
+    itpp::ivec interleaver_sequence_bvec = to_ivec(turbo_interleaver_sequence()[pb_size]);
+    turbo_codec.set_interleaver(interleaver_sequence_bvec);
+    turbo_codec.set_puncture_matrix(puncture_matrix);
 
-    itpp::vec decoder_input(d_turbo_codec.get_punctured_size());
+    itpp::vec decoder_input(turbo_codec.get_punctured_size());
     itpp::bvec decoded_bvec;
 
     unsigned int i = 0;
@@ -548,25 +685,18 @@ vector_int phy_service::tc_decoder(const vector_float &received_info, const vect
         decoder_input(i*2) = received_info[i]; // systematic bit is first
         decoder_input(i*2+1) = received_parity[i]; // parity bit is second
     }
-    for (int j = i*2; j < d_turbo_codec.get_punctured_size(); j++) {
+    for (int j = i*2; j < turbo_codec.get_punctured_size(); j++) {
         decoder_input(j) = received_parity[i++]; // put the rest of the parity bits (tail)
     }
 
-    d_turbo_codec.decode(decoder_input, decoded_bvec);
-    vector_int decoded = to_vector_int(decoded_bvec);
+    turbo_codec.decode(decoder_input, decoded_bvec);
+    decoded.resize(decoded_bvec.size());
+    for (int i = 0; i < decoded_bvec.size(); i++)
+        decoded[i] = decoded_bvec(i);
     DEBUG_VECTOR(decoded);
-
-    return decoded;
 }
 
 
-itpp::bvec phy_service::to_bvec (const vector_int in) {
-    itpp::bvec out(in.size());
-    for (unsigned int i = 0; i< in.size(); i++)
-        out(i) = in[i];
-    return out;
-}
-
 itpp::ivec phy_service::to_ivec (const vector_int in) {
     itpp::ivec out(in.size());
     for (unsigned int i = 0; i< in.size(); i++)
@@ -581,6 +711,11 @@ vector_int phy_service::to_vector_int (const itpp::bvec in) {
     return out;
 }
 
+const std::array<vector_int, 3> &phy_service::turbo_interleaver_sequence() {
+    static const std::array<vector_int, 3> sequence = calc_turbo_interleaver_sequence();
+    return sequence;
+}
+
 std::array<vector_int, 3>  phy_service::calc_turbo_interleaver_sequence(){
     static const int TCENCODER_SEED_PB16[IEEE1901_TCENCODER_SEED_PB16_N] = {IEEE1901_TCENCODER_SEED_PB16};
     static const int TCENCODER_SEED_PB136[IEEE1901_TCENCODER_SEED_PB136_N] = {IEEE1901_TCENCODER_SEED_PB136};
@@ -618,61 +753,123 @@ std::array<vector_int, 3>  phy_service::calc_turbo_interleaver_sequence(){
     return turbo_interleaver_sequence;
 }
 
-vector_int phy_service::channel_interleaver(const vector_int& bitstream, const vector_int& parity_bitstream, pb_size_t pb_size, code_rate_t rate) {
-    int step_size = CHANNEL_INTERLEAVER_STEPSIZE[pb_size][rate];
-    int offset = CHANNEL_INTERLEAVER_OFFSET[pb_size][rate];
-    int info_row_no = 0;
-    int n_info_rows_done = 0;
-    int n_parity_rows_done = 0;
-    int parity_row_no = offset;
-    bool parity_done = false, info_done = false;
-    int nibble_no = 0;
-    vector_int out(bitstream.size() + parity_bitstream.size());
-    vector_int::iterator iter = out.begin();
+const phy_service::channel_interleaver_tables_t &phy_service::channel_interleaver_tables() {
+    static const channel_interleaver_tables_t tables = [] {
+        channel_interleaver_tables_t tables;
+        calc_channel_interleaver_sequence(tables.interleaver_sequence, tables.deinterleaver_sequence);
+        return tables;
+    }();
+    return tables;
+}
+
+void phy_service::calc_channel_interleaver_sequence(std::array<std::array<vector_int, 3>, 3> &interleaver_sequence, std::array<std::array<vector_int, 3>, 3> &deinterleaver_sequence) {
+    // Run the row walk once per PB size and code rate on bit indices: index i < n_info stands for info
+    // bit i, and n_info + i for parity bit i. PB16 only carries the frame control (rate 1/2).
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            pb_size_t pb_size = (pb_size_t)i;
+            code_rate_t rate = (code_rate_t)j;
+            interleaver_sequence[i][j].clear();
+            deinterleaver_sequence[i][j].clear();
+            if (pb_size == PB16 && rate != RATE_1_2)
+                continue;
 
-    switch (rate) {
-    case RATE_1_2:
-        while (!info_done || !parity_done) {
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            parity_done = channel_interleaver_row(parity_bitstream, iter, step_size, parity_row_no, n_parity_rows_done, nibble_no);
-        }
-        break;
-
-    case RATE_16_21:
-        while (!info_done && !parity_done) {
-            for (int i=0; i<5; i++) {
-                info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-                info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-                info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-                parity_done = channel_interleaver_row(parity_bitstream, iter, step_size, parity_row_no, n_parity_rows_done, nibble_no, true);
+            int n_info = calc_phy_block_size(pb_size);
+            int n_parity = 0;
+            switch (rate) {
+                case RATE_1_2: n_parity = n_info + turbo_codec::N_PARITY_PAD_BITS; break; // non standard turbo encoder...
+                case RATE_16_21: n_parity = n_info * 5 / 16; break;
+                case RATE_16_18: n_parity = n_info * 2 / 16; break;
             }
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
+            vector_int info(n_info), parity(n_parity);
+            for (int k = 0; k < n_info; k++) info[k] = k;
+            for (int k = 0; k < n_parity; k++) parity[k] = n_info + k;
+
+            int step_size = CHANNEL_INTERLEAVER_STEPSIZE[pb_size][rate];
+            int offset = CHANNEL_INTERLEAVER_OFFSET[pb_size][rate];
+            int info_row_no = 0;
+            int n_info_rows_done = 0;
+            int n_parity_rows_done = 0;
+            int parity_row_no = offset;
+            bool parity_done = false, info_done = false;
+            int nibble_no = 0;
+            vector_int &out = interleaver_sequence[i][j];
+            out.reserve(n_info + n_parity);
+
+            switch (rate) {
+            case RATE_1_2:
+                while (!info_done || !parity_done) {
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    parity_done = channel_interleaver_row(parity, out, step_size, parity_row_no, n_parity_rows_done, nibble_no);
+                }
+                break;
+
+            case RATE_16_21:
+                while (!info_done && !parity_done) {
+                    for (int k=0; k<5; k++) {
+                        info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                        info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                        info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                        parity_done = channel_interleaver_row(parity, out, step_size, parity_row_no, n_parity_rows_done, nibble_no, true);
+                    }
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                }
+                break;
+
+            case RATE_16_18:
+                while (!info_done && !parity_done) {
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    parity_done = channel_interleaver_row(parity, out, step_size, parity_row_no, n_parity_rows_done, nibble_no, true);
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                    info_done = channel_interleaver_row(info, out, step_size, info_row_no, n_info_rows_done, nibble_no);
+                }
+                break;
+            }
+
+            // The inverse keeps the last position an index was sent at. With the padded rate 1/2 parity the walk
+            // skips a few parity bits (and sends others twice), these are marked with -1 and read back as erasures
+            vector_int &inverse = deinterleaver_sequence[i][j];
+            inverse.assign(n_info + n_parity, -1);
+            for (unsigned int k = 0; k < out.size(); k++)
+                inverse[out[k]] = k;
         }
-        break;
-
-    case RATE_16_18:
-        while (!info_done && !parity_done) {
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            parity_done = channel_interleaver_row(parity_bitstream, iter, step_size, parity_row_no, n_parity_rows_done, nibble_no, true);
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_interleaver_row(bitstream, iter, step_size, info_row_no, n_info_rows_done, nibble_no);
+    }
+}
+
+bitstream_t phy_service::channel_interleaver(const bitstream_t& bitstream, const bitstream_t& parity_bitstream, pb_size_t pb_size, code_rate_t rate) {
+    const vector_int &sequence = channel_interleaver_tables().interleaver_sequence[pb_size][rate];
+    assert(!sequence.empty() && bitstream.size() == (size_t)calc_phy_block_size(pb_size));
+    bitstream_t in(bitstream);
+    in.append(parity_bitstream);
+    assert(in.size() == sequence.size());
+
+    // Gather the output a word at a time
+    const uint64_t *in_words = in.words();
+    bitstream_t out;
+    out.reserve(sequence.size());
+    for (size_t i = 0; i < sequence.size(); i += bitstream_t::WORD_BITS) {
+        int n = std::min(sequence.size() - i, (size_t)bitstream_t::WORD_BITS);
+        uint64_t word = 0;
+        for (int j = 0; j < n; j++) {
+            int k = sequence[i + j];
+            word |= ((in_words[k / bitstream_t::WORD_BITS] >> (k % bitstream_t::WORD_BITS)) & 1) << j;
         }
-        break;
+        out.append_bits(word, n);
     }
     return out;
 }
 
-bool phy_service::channel_interleaver_row(const vector_int& bitstream, vector_int::iterator &iter, int step_size, int& row_no, int& rows_done, int& nibble_no, bool wrap) {
+bool phy_service::channel_interleaver_row(const vector_int& bitstream, vector_int &out, int step_size, int& row_no, int& rows_done, int& nibble_no, bool wrap) {
     int n_rows = bitstream.size()/4;
     if (rows_done < n_rows) {
         // Reading a row
-        for (int i = nibble_no / 2; i < (nibble_no / 2) + 4 ; i++, iter++)
-            *iter = (bitstream[row_no + (i % 4) * n_rows]); // read row row_no, element i
+        for (int i = nibble_no / 2; i < (nibble_no / 2) + 4 ; i++)
+            out.push_back(bitstream[row_no + (i % 4) * n_rows]); // read row row_no, element i
         rows_done++;
         nibble_no = (nibble_no + 1) % 8;
 
@@ -687,14 +884,29 @@ bool phy_service::channel_interleaver_row(const vector_int& bitstream, vector_in
     return false;
 }
 
-vector_int phy_service::robo_interleaver(const vector_int& bitstream, tone_mode_t tone_mode) {
+bitstream_t phy_service::robo_interleaver(const bitstream_t& bitstream, tone_mode_t tone_mode) {
     // Determine number of bits to pad at end of copy
     unsigned int n_raw = bitstream.size();
     unsigned int n_copies, bits_in_last_symbol, bits_in_segment, n_pad;
     calc_robo_parameters (tone_mode, n_raw, n_copies, bits_in_last_symbol, bits_in_segment, n_pad);
 
     // Set the bits shift parameters
-    std::vector<int> cycle_shifts(n_copies,0);
+    vector_int cycle_shifts = calc_robo_cycle_shifts(n_copies, bits_in_last_symbol, bits_in_segment);
+
+    // Perform the bits rotation and copying
+    bitstream_t robo_bitstream;
+    robo_bitstream.reserve((n_raw + n_pad) * n_copies);
+    for (unsigned int k=0; k<n_copies; k++) {
+        int start_position = (n_raw + n_pad - (cycle_shifts[k] * bits_in_segment)) % (n_raw + n_pad);
+        robo_bitstream.append(bitstream, start_position, n_raw);
+        robo_bitstream.append(bitstream, 0, n_pad);
+        robo_bitstream.append(bitstream, 0, start_position);
+    }
+    return robo_bitstream;
+}
+
+vector_int phy_service::calc_robo_cycle_shifts(unsigned int n_copies, unsigned int bits_in_last_symbol, unsigned int bits_in_segment) {
+    vector_int cycle_shifts(n_copies,0);
     int l = (bits_in_last_symbol - 1) / bits_in_segment;
     switch (n_copies) {
         case 2:  // l \in {0,1}
@@ -712,24 +924,51 @@ vector_int phy_service::robo_interleaver(const vector_int& bitstream, tone_mode_
                 cycle_shifts = {0,1,2,3,4};
             break;
     }
+    return cycle_shifts;
+}
+
+std::array<std::array<vector_int, 3>, 3> phy_service::calc_robo_deinterleaver_sequence(const std::array<tone_info_t, 3> &robo_tone_info) {
+    std::array<std::array<vector_int, 3>, 3> robo_deinterleaver_sequence;
+    for (int i = TM_STD_ROBO; i <= TM_MINI_ROBO; i++) {
+        tone_mode_t tone_mode = (tone_mode_t)i;
+        code_rate_t rate = robo_tone_info[tone_mode].rate;
+        for (int j = PB136; j <= PB520; j++) {
+            pb_size_t pb_size = (pb_size_t)j;
+            unsigned int n_raw = calc_encoded_block_size(rate, pb_size);
+            unsigned int n_copies, bits_in_last_symbol, bits_in_segment, n_pad;
+            calc_robo_parameters (tone_mode, n_raw, n_copies, bits_in_last_symbol, bits_in_segment, n_pad);
+            vector_int cycle_shifts = calc_robo_cycle_shifts(n_copies, bits_in_last_symbol, bits_in_segment);
+
+            // Position of copy k of raw bit r in the FEC block, laid out as robo_interleaver does:
+            // [start_position..n_raw) [n_pad] [0..start_position). The padding is not combined
+            vector_int raw_position(n_raw * n_copies);
+            for (unsigned int k = 0; k < n_copies; k++) {
+                unsigned int start_position = (n_raw + n_pad - (cycle_shifts[k] * bits_in_segment)) % (n_raw + n_pad);
+                unsigned int copy_begin = k * (n_raw + n_pad);
+                for (unsigned int r = start_position; r < n_raw; r++)
+                    raw_position[r * n_copies + k] = copy_begin + r - start_position;
+                for (unsigned int r = 0; r < start_position; r++)
+                    raw_position[r * n_copies + k] = copy_begin + n_raw - start_position + n_pad + r;
+            }
 
-    // Perform the bits rotation and copying
-    vector_int robo_bitstream((n_raw + n_pad) * n_copies);
-    vector_int::iterator robo_bitstream_iter = robo_bitstream.begin();
-    for (unsigned int k=0; k<n_copies; k++) {
-        int start_position = (n_raw + n_pad - (cycle_shifts[k] * bits_in_segment)) % (n_raw + n_pad);
-        robo_bitstream_iter = std::copy(bitstream.begin() + start_position, bitstream.end(), robo_bitstream_iter);
-        robo_bitstream_iter = std::copy(bitstream.begin(), bitstream.begin() + n_pad, robo_bitstream_iter);
-        robo_bitstream_iter = std::copy(bitstream.begin(), bitstream.begin() + start_position, robo_bitstream_iter);
+            // Compose with the channel deinterleaver: entry [i*n_copies+k] is copy k of deinterleaved bit i
+            const vector_int &deinterleaver_sequence = channel_interleaver_tables().deinterleaver_sequence[pb_size][rate];
+            assert(deinterleaver_sequence.size() == n_raw);
+            vector_int &out = robo_deinterleaver_sequence[tone_mode][pb_size];
+            out.resize(n_raw * n_copies);
+            for (unsigned int b = 0; b < n_raw; b++)
+                for (unsigned int k = 0; k < n_copies; k++)
+                    out[b * n_copies + k] = deinterleaver_sequence[b] < 0 ? -1 : raw_position[deinterleaver_sequence[b] * n_copies + k];
+        }
     }
-    return robo_bitstream;
+    return robo_deinterleaver_sequence;
 }
 
-phy_service::tone_info_t phy_service::get_tone_info (tone_mode_t tone_mode) {
+const phy_service::tone_info_t &phy_service::get_tone_info (tone_mode_t tone_mode) {
     switch (tone_mode) {
-        case TM_STD_ROBO: return TONE_INFO_STD_ROBO; break;
-        case TM_HS_ROBO: return TONE_INFO_HS_ROBO; break;
-        case TM_MINI_ROBO: return TONE_INFO_MINI_ROBO; break;
+        case TM_STD_ROBO:
+        case TM_HS_ROBO:
+        case TM_MINI_ROBO: return ROBO_TABLES->tone_info[tone_mode]; break;
         default: return d_custom_tone_info; break;
     }
 }
@@ -762,6 +1001,7 @@ phy_service::tone_info_t phy_service::calc_robo_tone_info (tone_mode_t tone_mode
         i--;
     }
     update_tone_info_capacity(tone_info);
+    update_tone_info_plan(tone_info);
     return tone_info;
 }
 
@@ -794,48 +1034,109 @@ void phy_service::calc_robo_parameters (tone_mode_t tone_mode, unsigned int n_ra
     return;
 }
 
-vector_complex phy_service::modulate(const vector_int& bits, const phy_service::tone_info_t& tone_info) {
+vector_complex phy_service::modulate(const bitstream_t& bits, const phy_service::tone_info_t& tone_info) {
     // Calculate number of symbols needed
     int n_symbols = (bits.size() && (bits.size() % tone_info.capacity)) ? bits.size() / tone_info.capacity + 1 : bits.size() / tone_info.capacity;
     vector_complex symbols_freq(n_symbols * NUMBER_OF_CARRIERS);
-    vector_complex::iterator symbols_freq_iter = symbols_freq.begin();
+
     // Perform mapping
-    vector_int::const_iterator it = bits.cbegin();
-    int pn_state = pn_generator_init();
-    for (int j = 0; j < n_symbols; j++) {
-        for (int i=0; i<NUMBER_OF_CARRIERS; i++, symbols_freq_iter++) {
-            if (!TONE_MASK[i]) // if regulations do not allow the carrier to transmit
-                continue;
-            else if (tone_info.tone_map[i] != MT_NULLED) {  // If carrier is ON
-                modulation_map_t modulation_map = MODULATION_MAP[tone_info.tone_map[i]];
-                int n_bits = modulation_map.n_bits;
+    size_t bit_pos = 0;
+    int pn_step = 0;
+    for (int j = 0; j < n_symbols; j++)
+        modulate_symbol(bits, bit_pos, pn_step, tone_info, symbols_freq.data() + j * NUMBER_OF_CARRIERS);
+
+    return symbols_freq;
+}
+
+void phy_service::modulate_symbol(const bitstream_t& bits, size_t &bit_pos, int &pn_step, const phy_service::tone_info_t& tone_info, complex *symbol, bool fft_order) {
+    static_assert((NUMBER_OF_CARRIERS & (NUMBER_OF_CARRIERS - 1)) == 0, "Carrier wrap assumes a power of 2");
+    const int wrap = fft_order ? NUMBER_OF_CARRIERS / 2 : 0; // carrier i is written at i ^ wrap
+    const modulation_plan_t &plan = tone_info.plan;
+    const rotated_maps_t &rotated_maps = rotated_modulation_maps();
+    const pn_table_t &pn_table = pn_generator_table();
+
+    if (bit_pos + plan.n_bits <= bits.size()) {
+        // All carriers which are ON carry data bits, map them modulation by modulation
+        for (int m = MT_BPSK; m <= MT_QAM4096; m++) {
+            const vector_int &carriers = plan.carriers[m];
+            const vector_int &bit_offsets = plan.bit_offsets[m];
+            int n_bits = MODULATION_MAP[m].n_bits;
+            for (size_t k = 0; k < carriers.size(); k++)
+                symbol[carriers[k] ^ wrap] = rotated_maps[m][CARRIERS_ANGLE_NUMBER[carriers[k]]][bits.get_bits(bit_pos + bit_offsets[k], n_bits)];
+        }
+        bit_pos += plan.n_bits;
+
+        // Carriers which are OFF use random bit with BPSK modulation
+        for (size_t k = 0; k < plan.off_carriers.size(); k++) {
+            symbol[plan.off_carriers[k] ^ wrap] = pn_table.filler[pn_step];
+            pn_step = (pn_step + 1) % PN_PERIOD;
+        }
+    } else {
+        // Last symbol: when all bits are mapped, the carriers which are ON use random bits instead
+        for (size_t k = 0; k < plan.tx_carriers.size(); k++) {
+            int i = plan.tx_carriers[k];
+            modulation_type_t modulation = tone_info.tone_map[i];
+            if (modulation != MT_NULLED) {
+                int n_bits = MODULATION_MAP[modulation].n_bits;
                 int decimal = 0;
-                int bit_no = 0;
-                while (bit_no < n_bits) {
-                    if (it != bits.cend()) { // If there are still bits to map, use them
-                        decimal |= *it << bit_no;
-                        bit_no++;
-                        it++;
-                    } else {  // When all bits are mapped, use random bits instead
-                        decimal |= pn_generator(n_bits-bit_no, pn_state) << bit_no;
-                        break;
-                    }
+                if (bit_pos + n_bits <= bits.size()) {
+                    decimal = bits.get_bits(bit_pos, n_bits);
+                    bit_pos += n_bits;
+                } else {
+                    int bit_no = bits.size() - bit_pos;
+                    decimal = bits.get_bits(bit_pos, bit_no) | ((pn_table.value[pn_step] & ((1 << (n_bits - bit_no)) - 1)) << bit_no);
+                    pn_step = (pn_step + 1) % PN_PERIOD;
+                    bit_pos += bit_no;
                 }
-                // Convert the angle number to its value
-                complex p = ANGLE_NUMBER_TO_VALUE[CARRIERS_ANGLE_NUMBER[i] * 2];
+                symbol[i ^ wrap] = rotated_maps[modulation][CARRIERS_ANGLE_NUMBER[i]][decimal];
+            } else {
+                symbol[i ^ wrap] = pn_table.filler[pn_step];
+                pn_step = (pn_step + 1) % PN_PERIOD;
+            }
+        }
+    }
+}
+
+const phy_service::rotated_maps_t &phy_service::rotated_modulation_maps() {
+    static const rotated_maps_t rotated_maps = calc_rotated_modulation_maps();
+    return rotated_maps;
+}
+
+phy_service::rotated_maps_t phy_service::calc_rotated_modulation_maps() {
+    rotated_maps_t rotated_maps;
+    for (int m = MT_BPSK; m <= MT_QAM4096; m++) {
+        modulation_map_t modulation_map = MODULATION_MAP[m];
+        for (int a = 0; a < N_CARRIER_ANGLES; a++) {
+            // Convert the angle number to its value
+            complex p = ANGLE_NUMBER_TO_VALUE[a * 2];
+            rotated_maps[m][a] = vector_complex(1 << modulation_map.n_bits);
+            for (size_t d = 0; d < rotated_maps[m][a].size(); d++) {
                 // Calculate the mapped value. Multiplying by the scale for unity average power.
                 // Multiplying by N so in time domain this will produce cos() with unit amplitude
-                complex m = modulation_map.map[decimal] * modulation_map.scale * (float)NUMBER_OF_CARRIERS;
-                 // Rotate the mapped value using the angle number and add it to the mapped values vector
-                *symbols_freq_iter = complex(m.real() * p.real() - m.imag() * p.imag(),
-                                             m.real() * p.imag() + m.imag() * p.real());
-            } else {  // If carrier is OFF use random bit with BPSK modulation
-                *symbols_freq_iter = MODULATION_MAP[MT_BPSK].map[pn_generator(1, pn_state)] * MODULATION_MAP[MT_BPSK].scale * (float)NUMBER_OF_CARRIERS;
+                complex v = modulation_map.map[d] * modulation_map.scale * (float)NUMBER_OF_CARRIERS;
+                // Rotate the mapped value using the angle number
+                rotated_maps[m][a][d] = complex(v.real() * p.real() - v.imag() * p.imag(),
+                                                v.real() * p.imag() + v.imag() * p.real());
             }
-        } // Repeat until entire symbol is filled
-    } // Keep add symbols until all bits are mapped
+        }
+    }
+    return rotated_maps;
+}
 
-    return symbols_freq;
+const phy_service::pn_table_t &phy_service::pn_generator_table() {
+    static const pn_table_t pn_table = calc_pn_generator_table();
+    return pn_table;
+}
+
+phy_service::pn_table_t phy_service::calc_pn_generator_table() {
+    pn_table_t pn_table;
+    int pn_state = pn_generator_init();
+    for (int i = 0; i < PN_PERIOD; i++) {
+        pn_table.value[i] = pn_generator(12, pn_state); // 12 bits are enough for any modulation
+        pn_table.filler[i] = MODULATION_MAP[MT_BPSK].map[pn_table.value[i] & 1] * MODULATION_MAP[MT_BPSK].scale * (float)NUMBER_OF_CARRIERS;
+    }
+    assert(pn_state == pn_generator_init()); // maximum length sequence
+    return pn_table;
 }
 
 vector_complex::iterator phy_service::ifft(vector_complex::const_iterator iter_begin, vector_complex::const_iterator iter_end, vector_complex::iterator iter_out) {
@@ -843,7 +1144,7 @@ vector_complex::iterator phy_service::ifft(vector_complex::const_iterator iter_b
     // Wrap the carrier by N/2, so N/2 carrier becomes first and so on...
     std::copy(iter_begin + NUMBER_OF_CARRIERS/2, iter_end, (complex*)d_ifft_input);
     std::copy(iter_begin, iter_begin + NUMBER_OF_CARRIERS/2, (complex*)d_ifft_input + NUMBER_OF_CARRIERS/2);
-    fftwf_execute(d_fftw_rev_plan);
+    fftwf_execute_dft(fftw_plans().rev, d_ifft_input, d_ifft_output);
     iter_out = std::copy ((complex*)d_ifft_output, (complex*)d_ifft_output + NUMBER_OF_CARRIERS, iter_out);
     return iter_out;
 }
@@ -851,13 +1152,42 @@ vector_complex::iterator phy_service::ifft(vector_complex::const_iterator iter_b
 vector_complex::iterator phy_service::fft(vector_complex::const_iterator iter_begin, vector_complex::const_iterator iter_end, vector_complex::iterator iter_out) {
     assert (iter_end - iter_begin ==  NUMBER_OF_CARRIERS);
     std::copy(iter_begin, iter_end, (complex*)d_fft_input);
-    fftwf_execute(d_fftw_fwd_plan);
+    fftwf_execute_dft(fftw_plans().fwd, d_fft_input, d_fft_output);
     // Unwrap the carriers by N/2: 1st carrier becomes N/2 and so on...
     iter_out = std::copy ((complex*)d_fft_output + NUMBER_OF_CARRIERS / 2, (complex*)d_fft_output + NUMBER_OF_CARRIERS, iter_out);
     iter_out = std::copy ((complex*)d_fft_output, (complex*)d_fft_output + NUMBER_OF_CARRIERS / 2, iter_out);
     return iter_out;
 }
 
+void phy_service::ifft_symbols(const complex *in, complex *out, size_t n_symbols) {
+    execute_symbols(fftw_plans().rev_batch, fftw_plans().rev, d_ifft_batch_input, d_ifft_batch_output, in, out, n_symbols);
+}
+
+void phy_service::fft_symbols(const complex *in, complex *out, size_t n_symbols) {
+    execute_symbols(fftw_plans().fwd_batch, fftw_plans().fwd, d_fft_batch_input, d_fft_batch_output, in, out, n_symbols);
+}
+
+void phy_service::execute_symbols(const fftwf_plan &batch_plan, const fftwf_plan &plan, fftwf_complex *batch_input, fftwf_complex *batch_output, const complex *in, complex *out, size_t n_symbols) {
+    // The plans were created on fftw allocated buffers, other arrays can be used if they have the same alignment
+    bool aligned = fftwf_alignment_of((float*)in) == fftwf_alignment_of((float*)batch_input) &&
+                   fftwf_alignment_of((float*)out) == fftwf_alignment_of((float*)batch_output);
+    size_t i = 0;
+    while (i < n_symbols) {
+        size_t n = (n_symbols - i >= FFT_BATCH_SIZE) ? FFT_BATCH_SIZE : 1;
+        fftwf_plan p = (n == FFT_BATCH_SIZE) ? batch_plan : plan;
+        const complex *symbols_in = in + i * NUMBER_OF_CARRIERS;
+        complex *symbols_out = out + i * NUMBER_OF_CARRIERS;
+        if (aligned) {
+            fftwf_execute_dft(p, (fftwf_complex*)symbols_in, (fftwf_complex*)symbols_out);
+        } else {
+            std::copy(symbols_in, symbols_in + n * NUMBER_OF_CARRIERS, (complex*)batch_input);
+            fftwf_execute_dft(p, batch_input, batch_output);
+            std::copy((complex*)batch_output, (complex*)batch_output + n * NUMBER_OF_CARRIERS, symbols_out);
+        }
+        i += n;
+    }
+}
+
 vector_complex::iterator phy_service::append_datastream(vector_complex::const_iterator symbol_iter_begin, vector_complex::const_iterator symbol_iter_end, vector_complex::iterator iter_out, size_t cp_length, float gain) {
     static const float ROLLOFF_WINDOW_RISE[ROLLOFF_INTERVAL] = {IEEE1901_ROLLOFF_WINDOW_RISE};
     static const float ROLLOFF_WINDOW_FALL[ROLLOFF_INTERVAL] = {IEEE1901_ROLLOFF_WINDOW_FALL};
@@ -895,18 +1225,17 @@ vector_complex::iterator phy_service::append_datastream(vector_complex::const_it
 
 }
 
-vector_int phy_service::copier(const vector_int& bitstream, int n_carriers, int offset, int start) {
+bitstream_t phy_service::copier(const bitstream_t& bitstream, int n_carriers, int offset, int start) {
     /* copier should replicate and interleave the 256 bits as follows:
        Original bit number order (k): 0   1   2   3   4   5   6 ... 254 255 0   1   2   3   4   5   ... 254 255 ...
                            New order: 0   128 1   129 2   130 3 ... 127 255 128 0   129 1   130 2   ... 255 128 ...
                             Location: 0   1   2   3   4   5   6 ... 254 255 256 257 258 259 260 261 ... 510 511 ... n_carriers*2
     */
-    vector_int copier_output(n_carriers*2);
+    bitstream_t copier_output;
+    copier_output.reserve(n_carriers*2);
     int size = bitstream.size();
-    for (int i = 0; i<n_carriers; i++) {
-            copier_output[2*i] = bitstream[(start + i) % size];
-            copier_output[2*i+1] = bitstream[(start + i + offset) % size];
-    }
+    for (int i = 0; i<n_carriers; i++)
+        copier_output.append_bits(bitstream[(start + i) % size] | (bitstream[(start + i + offset) % size] << 1), 2);
     return copier_output;
 }
 
@@ -920,6 +1249,44 @@ int phy_service::pn_generator_init(void) {
     return 0x3FF;
 }
 
+std::shared_ptr<const phy_service::sync_tables_t> phy_service::shared_sync_tables() {
+    static std::mutex mtx;
+    static std::map<sync_tone_mask_t, std::shared_ptr<const sync_tables_t> > tables_by_mask;
+    std::lock_guard<std::mutex> lck (mtx);
+    std::shared_ptr<const sync_tables_t> &tables = tables_by_mask[SYNC_TONE_MASK];
+    if (!tables) {
+        std::shared_ptr<sync_tables_t> new_tables = std::make_shared<sync_tables_t>();
+        calc_preamble(new_tables->preamble, new_tables->syncp_freq);
+        new_tables->fine_sync_reference_freq = calc_fine_sync_reference_freq(new_tables->preamble);
+        tables = new_tables;
+    }
+    return tables;
+}
+
+std::shared_ptr<const phy_service::robo_tables_t> phy_service::shared_robo_tables() {
+    static std::mutex mtx;
+    static std::map<std::pair<tone_mask_t, tone_mask_t>, std::shared_ptr<const robo_tables_t> > tables_by_mask;
+    std::lock_guard<std::mutex> lck (mtx);
+    std::shared_ptr<const robo_tables_t> &tables = tables_by_mask[std::make_pair(TONE_MASK, BROADCAST_TONE_MASK)];
+    if (!tables) {
+        std::shared_ptr<robo_tables_t> new_tables = std::make_shared<robo_tables_t>();
+        for (int i = TM_STD_ROBO; i <= TM_MINI_ROBO; i++) {
+            tone_mode_t tone_mode = (tone_mode_t)i;
+            new_tables->tone_info[tone_mode] = calc_robo_tone_info(tone_mode);
+            new_tables->fec_block_size[tone_mode].fill(0); // PB16 only carries the frame control
+            for (int j = PB136; j <= PB520; j++) {
+                unsigned int n_raw = calc_encoded_block_size(new_tables->tone_info[tone_mode].rate, (pb_size_t)j);
+                unsigned int n_copies, bits_in_last_symbol, bits_in_segment, n_pad;
+                calc_robo_parameters (tone_mode, n_raw, n_copies, bits_in_last_symbol, bits_in_segment, n_pad);
+                new_tables->fec_block_size[tone_mode][j] = (n_raw + n_pad) * n_copies;
+            }
+        }
+        new_tables->deinterleaver_sequence = calc_robo_deinterleaver_sequence(new_tables->tone_info);
+        tables = new_tables;
+    }
+    return tables;
+}
+
 void phy_service::calc_preamble(vector_complex &preamble, vector_complex &syncp_freq) {
     static const int SYNCP_CARRIERS_ANGLE_NUMBER [SYNCP_SIZE] = {IEEE1901_SYNCP_CARRIERS_ANGLE_NUMBER};
 
@@ -957,128 +1324,210 @@ void phy_service::calc_preamble(vector_complex &preamble, vector_complex &syncp_
     DEBUG_VECTOR(preamble);
 }
 
+vector_complex phy_service::calc_fine_sync_reference_freq(const vector_complex &preamble) {
+    // The SYNCP to SYNCM transition makes the cross-correlation peak unique, SYNCPs alone repeat every SYNCP_SIZE
+    vector_complex reference(NUMBER_OF_CARRIERS), reference_freq(NUMBER_OF_CARRIERS);
+    std::copy(preamble.begin() + FINE_SYNC_REFERENCE_OFFSET, preamble.begin() + FINE_SYNC_REFERENCE_OFFSET + FINE_SYNC_REFERENCE_SIZE, reference.begin());
+    fft(reference.begin(), reference.end(), reference_freq.begin());
+    for (auto &x : reference_freq)
+        x = std::conj(x);
+    return reference_freq;
+}
+
 unsigned int phy_service::count_non_masked_carriers(tone_mask_t::const_iterator begin, tone_mask_t::const_iterator end) {
     return std::count(begin, end, true);
 }
 
 void phy_service::process_ppdu_payload(vector_complex::const_iterator iter, unsigned char *mpdu_payload_bin) {
-    vector_int payload_bits(process_ppdu_payload(iter));
-    pack_bitvector(payload_bits.begin(), payload_bits.end(), mpdu_payload_bin);
+    decode_ppdu_payload(iter).to_bytes(mpdu_payload_bin);
     return;
 }
 
 vector_int phy_service::process_ppdu_payload(vector_complex::const_iterator iter) {
-    size_t n_symbols = d_rx_params.n_symbols;
-    size_t fec_block_size = d_rx_params.fec_block_size;
-    size_t n_blocks = d_rx_params.n_blocks;
-    pb_size_t pb_size = d_rx_params.pb_size;
+    return decode_ppdu_payload(iter).to_vector_int();
+}
 
-    if (!n_symbols){
-        d_rx_payload_symbols_freq = vector_complex();
-        d_rx_soft_bits = vector_float();
-        d_rx_mpdu_payload = vector_int();
-        return vector_int(0);
-    }
+const bitstream_t &phy_service::decode_ppdu_payload(vector_complex::const_iterator iter) {
+    size_t n_symbols = d_rx_params.n_symbols;
+    reset_payload_decoder();
+    if (!n_symbols)
+        return d_rx_mpdu_payload;
 
     // Slice to symbols
-    iter += IEEE1901_GUARD_INTERVAL_PAYLOAD;
-    vector_complex symbols(n_symbols * NUMBER_OF_CARRIERS);
-    vector_complex::iterator symbols_iter = symbols.begin();
+    vector_complex &symbols = d_rx_workspace.symbols;
+    symbols.resize(n_symbols * NUMBER_OF_CARRIERS);
     for (unsigned int i = 0; i < n_symbols; i++) {
-        symbols_iter = std::copy(iter, iter + (NUMBER_OF_CARRIERS - ROLLOFF_INTERVAL), symbols_iter);
-        symbols_iter = std::copy(iter - ROLLOFF_INTERVAL, iter, symbols_iter);
-        iter += NUMBER_OF_CARRIERS + IEEE1901_GUARD_INTERVAL_PAYLOAD;
+        slice_payload_symbol(iter, symbols.data() + i * NUMBER_OF_CARRIERS);
+        iter += PAYLOAD_SYMBOL_SIZE;
     }
 
     // Calc the freq domain symbols
-    d_rx_payload_symbols_freq = vector_complex(n_symbols * NUMBER_OF_CARRIERS);
-    vector_complex::iterator symbols_freq_iter = d_rx_payload_symbols_freq.begin();
-    for (symbols_iter = symbols.begin(); symbols_iter != symbols.end(); symbols_iter+=NUMBER_OF_CARRIERS) {
-        // Perform FFT to get the freq domain of the received signal
-        symbols_freq_iter = fft(symbols_iter, symbols_iter + NUMBER_OF_CARRIERS, symbols_freq_iter);
-        DEBUG_VECTOR_RANGE("symbols_freq", symbols_freq_iter - NUMBER_OF_CARRIERS, symbols_freq_iter)
-    }
+    fft_symbols(symbols.data(), d_rx_payload_symbols_freq.data(), n_symbols);
+    DEBUG_VECTOR(d_rx_payload_symbols_freq);
+    d_rx_n_symbols_received = n_symbols;
 
-    tone_info_t tone_info = get_tone_info(d_rx_params.tone_mode);
+    decode_payload_symbols();
+    return d_rx_mpdu_payload;
+}
 
-    // Perform channel estimation based on payload QPSK carriers or preamble
-    if (d_rx_params.tone_mode == TM_NO_ROBO) {
-        if (d_channel_est_mode == CE_PAYLOAD)
-            estimate_channel_gain_payload(d_rx_payload_symbols_freq.begin(), d_rx_payload_symbols_freq.end(), d_qpsk_tone_mask, d_channel_response);
-        else if (d_channel_est_mode == CE_PREAMBLE)
-            estimate_channel_gain_preamble(d_channel_response);
-    }
-    stats.channel = d_channel_response.carriers;
-    DEBUG_VECTOR(d_channel_response.carriers);
+bool phy_service::process_ppdu_payload_symbol(vector_complex::const_iterator iter) {
+    assert(d_rx_n_symbols_received < d_rx_params.n_symbols);
+    vector_complex &symbol = d_rx_workspace.symbols;
+    symbol.resize(NUMBER_OF_CARRIERS);
+    slice_payload_symbol(iter, symbol.data());
+    fft_symbols(symbol.data(), d_rx_payload_symbols_freq.data() + d_rx_n_symbols_received * NUMBER_OF_CARRIERS, 1);
+    d_rx_n_symbols_received++;
 
-    // Demodulate
-    d_rx_soft_bits = vector_float(tone_info.capacity * n_symbols);
-    vector_float::iterator rx_soft_bits_iter = d_rx_soft_bits.begin();
-    rx_soft_bits_iter = demodulate_symbols(d_rx_payload_symbols_freq.begin(), d_rx_payload_symbols_freq.end(), rx_soft_bits_iter, tone_info.tone_map, d_channel_response);
-
-    // Trim the dummy bits in the last symbol
-    d_rx_soft_bits.erase(d_rx_soft_bits.begin() + n_blocks * fec_block_size, d_rx_soft_bits.end());
-    DEBUG_VECTOR(d_rx_soft_bits);
-
-    // Deinterleave and decode blocks
-    rx_soft_bits_iter = d_rx_soft_bits.begin();
-    int scrambler_state = scrambler_init(); // init the scrambler state
-    d_rx_mpdu_payload = vector_int(n_blocks * calc_phy_block_size(pb_size));
-    vector_int::iterator payload_bits_iter = d_rx_mpdu_payload.begin();
-    for (size_t i = 0; i< n_blocks; i++) {
-        vector_float block_bits = vector_float(rx_soft_bits_iter, rx_soft_bits_iter + fec_block_size);
-        vector_float received_info;
-        vector_float received_parity;
-        vector_int decoded_info;
-
-        if (d_rx_params.tone_mode != TM_NO_ROBO) {
-            vector_float robo_deinterleaved = robo_deinterleaver(block_bits, calc_encoded_block_size(tone_info.rate, pb_size), d_rx_params.tone_mode);
-            DEBUG_VECTOR(robo_deinterleaved);
-            received_info = channel_deinterleaver(robo_deinterleaved, received_parity, pb_size, tone_info.rate);
-        } else {
-            received_info = channel_deinterleaver(block_bits, received_parity, pb_size, tone_info.rate);
-        }
+    decode_payload_symbols();
+    return d_rx_n_symbols_received == d_rx_params.n_symbols;
+}
 
-        decoded_info = tc_decoder(received_info, received_parity, pb_size, tone_info.rate);
+void phy_service::get_mpdu_payload(unsigned char *mpdu_payload_bin) {
+    assert(d_rx_n_blocks_decoded == d_rx_params.n_blocks);
+    d_rx_mpdu_payload.to_bytes(mpdu_payload_bin);
+}
 
-        DEBUG_VECTORINT_PACK(decoded_info);
+void phy_service::reset_payload_decoder() {
+    const tone_info_t &tone_info = get_tone_info(d_rx_params.tone_mode);
+    d_rx_n_symbols_received = 0;
+    d_rx_n_symbols_demodulated = 0;
+    d_rx_n_blocks_decoded = 0;
+    d_rx_equalizer_ready = false;
+    // Resized rather than reallocated, every element is written before it is read
+    d_rx_payload_symbols_freq.resize(d_rx_params.n_symbols * NUMBER_OF_CARRIERS);
+    d_rx_soft_bits.resize(tone_info.capacity * d_rx_params.n_symbols);
+    d_rx_mpdu_payload.resize(d_rx_params.n_blocks * calc_phy_block_size(d_rx_params.pb_size));
+}
 
-        vector_int descrambled = scrambler(decoded_info, scrambler_state);
-        DEBUG_VECTOR(descrambled);
+void phy_service::slice_payload_symbol(vector_complex::const_iterator iter, complex *symbol) {
+    // Skip the guard interval, the rolloff part of the symbol is taken from its end.
+    // Multiplying sample n by (-1)^n shifts the spectrum by N/2, so the FFT output comes out
+    // unwrapped (1st carrier at N/2 and so on...)
+    const complex *samples = &*iter + IEEE1901_GUARD_INTERVAL_PAYLOAD;
+    for (int n = 0; n < NUMBER_OF_CARRIERS - ROLLOFF_INTERVAL; n++)
+        symbol[n] = (n & 1) ? -samples[n] : samples[n];
+    for (int n = NUMBER_OF_CARRIERS - ROLLOFF_INTERVAL; n < NUMBER_OF_CARRIERS; n++)
+        symbol[n] = (n & 1) ? -samples[n - NUMBER_OF_CARRIERS] : samples[n - NUMBER_OF_CARRIERS];
+}
+
+void phy_service::decode_payload_symbols() {
+    size_t n_symbols = d_rx_params.n_symbols;
+    size_t fec_block_size = d_rx_params.fec_block_size;
+    size_t n_blocks = d_rx_params.n_blocks;
+    bool complete = (d_rx_n_symbols_received == n_symbols);
+    const tone_info_t &tone_info = get_tone_info(d_rx_params.tone_mode);
+
+    if (!d_rx_equalizer_ready) {
+        // Perform channel estimation based on payload QPSK carriers or preamble. The payload
+        // estimation averages over all the symbols, so it has to wait for the last one
+        if (d_rx_params.tone_mode == TM_NO_ROBO) {
+            if (d_channel_est_mode == CE_PAYLOAD) {
+                if (!complete)
+                    return;
+                estimate_channel_gain_payload(d_rx_payload_symbols_freq.begin(), d_rx_payload_symbols_freq.end(), d_qpsk_tone_mask, d_channel_response);
+            } else if (d_channel_est_mode == CE_PREAMBLE)
+                estimate_channel_gain_preamble(d_channel_response);
+        }
+        stats.channel = d_channel_response.carriers;
+        DEBUG_VECTOR(d_channel_response.carriers);
+        calc_equalizer(tone_info.tone_map, d_channel_response, d_rx_equalizer);
+        d_rx_equalizer_ready = true;
+    }
+
+    // Demodulate the symbols received so far
+    demodulate_symbols(d_rx_payload_symbols_freq.begin() + d_rx_n_symbols_demodulated * NUMBER_OF_CARRIERS,
+                       d_rx_payload_symbols_freq.begin() + d_rx_n_symbols_received * NUMBER_OF_CARRIERS,
+                       d_rx_soft_bits.begin() + d_rx_n_symbols_demodulated * tone_info.capacity, d_rx_equalizer);
+    d_rx_n_symbols_demodulated = d_rx_n_symbols_received;
+    size_t n_soft_bits = d_rx_n_symbols_demodulated * tone_info.capacity;
+
+    // Decode the blocks whose soft bits are all in. Lane k decodes every n_lanes-th block with its
+    // own turbo codec, and each block is written to its own slice of the payload
+    size_t first_block = d_rx_n_blocks_decoded;
+    size_t end_block = n_blocks ? std::min(n_blocks, n_soft_bits / fec_block_size) : 0;
+    if (end_block > first_block) {
+        size_t n_lanes = d_debug ? 1 : std::min<size_t>(d_decoder_threads, end_block - first_block); // keep the debug output in order
+        std::function<void(size_t)> decode_lane = [&](size_t lane) {
+            for (size_t i = first_block + lane; i < end_block; i += n_lanes)
+                decode_payload_block(i, lane);
+        };
+        if (n_lanes > 1)
+            d_decoder_pool->parallel_for(n_lanes, decode_lane);
+        else
+            decode_lane(0);
+        d_rx_n_blocks_decoded = end_block;
+    }
 
-        payload_bits_iter = std::copy(descrambled.begin(),descrambled.end(), payload_bits_iter);
-        rx_soft_bits_iter += fec_block_size;
+    if (complete) {
+        assert(d_rx_n_blocks_decoded == n_blocks);
+        // Trim the dummy bits in the last symbol
+        d_rx_soft_bits.erase(d_rx_soft_bits.begin() + n_blocks * fec_block_size, d_rx_soft_bits.end());
+        DEBUG_VECTOR(d_rx_soft_bits);
+        DEBUG_VECTOR(d_rx_mpdu_payload);
     }
-    DEBUG_VECTOR(d_rx_mpdu_payload);
+}
 
-    return d_rx_mpdu_payload;
+void phy_service::decode_payload_block(size_t block, size_t lane) {
+    const tone_info_t &tone_info = get_tone_info(d_rx_params.tone_mode);
+    rx_lane_workspace_t &workspace = d_rx_workspace.lanes[lane];
+    vector_float &received_info = workspace.received_info;
+    vector_float &received_parity = workspace.received_parity;
+    pb_size_t pb_size = d_rx_params.pb_size;
+    vector_float::const_iterator rx_soft_bits_iter = d_rx_soft_bits.begin() + block * d_rx_params.fec_block_size;
+
+    // Deinterleave and decode
+    if (d_rx_params.tone_mode != TM_NO_ROBO)
+        robo_channel_deinterleaver(rx_soft_bits_iter, received_info, received_parity, d_rx_params.tone_mode, pb_size, tone_info.rate);
+    else
+        channel_deinterleaver(rx_soft_bits_iter, received_info, received_parity, pb_size, tone_info.rate);
+    DEBUG_VECTOR(received_info);
+
+    vector_int &decoded_info = workspace.decoded_info;
+    tc_decoder(received_info, received_parity, pb_size, tone_info.rate, decoded_info, lane);
+
+    DEBUG_VECTORINT_PACK(decoded_info);
+
+    // Descramble in place, starting from the scrambler state at the beginning of the block
+    size_t block_n_bits = calc_phy_block_size(pb_size);
+    int scrambler_state = scrambler_jump(scrambler_init(), block * block_n_bits);
+    bitstream_t &descrambled = workspace.descrambled;
+    descrambled.assign(decoded_info);
+    scrambler(descrambled, scrambler_state, descrambled);
+    DEBUG_VECTOR(descrambled);
+
+    // The blocks are a whole number of words, so the slices do not share words
+    assert(descrambled.size() == block_n_bits && block_n_bits % bitstream_t::WORD_BITS == 0);
+    std::copy(descrambled.words(), descrambled.words() + descrambled.n_words(), d_rx_mpdu_payload.words() + block * block_n_bits / bitstream_t::WORD_BITS);
 }
 
 void phy_service::post_process_ppdu() {
     if (d_rx_params.n_symbols) { // If bits received, use them to calculate BER and channel estimation
         assert(d_rx_soft_bits.size());
         int n_blocks =  d_rx_soft_bits.size() / d_rx_params.fec_block_size;
-        tone_info_t tone_info = get_tone_info(d_rx_params.tone_mode);
+        const tone_info_t &tone_info = get_tone_info(d_rx_params.tone_mode);
 
         // Find the received hard bits (convert from soft to hard)
-        vector_int hard_demodulated_bits(d_rx_params.fec_block_size * n_blocks);
-        std::transform(d_rx_soft_bits.begin(), d_rx_soft_bits.begin() + hard_demodulated_bits.size(), hard_demodulated_bits.begin(), [](float v){return v<0;});
+        bitstream_t hard_demodulated_bits(d_rx_params.fec_block_size * n_blocks);
+        for (size_t i=0; i<hard_demodulated_bits.size(); i++)
+            if (d_rx_soft_bits[i] < 0)
+                hard_demodulated_bits.set(i, 1);
         DEBUG_VECTOR(hard_demodulated_bits);
 
         // Find the expected hard bits
-        vector_int mpdu_payload_ref;
+        bitstream_t mpdu_payload_ref;
         if (d_rx_params.type == DT_SOUND) // if sound, the expected bits are zeros
-            mpdu_payload_ref = vector_int(d_rx_mpdu_payload.size());
+            mpdu_payload_ref = bitstream_t(d_rx_mpdu_payload.size());
         else
             mpdu_payload_ref = d_rx_mpdu_payload;
         assert(mpdu_payload_ref.size());
-        vector_int hard_demodulated_bits_ref = encode_payload(mpdu_payload_ref, d_rx_params.pb_size, tone_info.rate, d_rx_params.tone_mode);
+        bitstream_t hard_demodulated_bits_ref = encode_payload(mpdu_payload_ref, d_rx_params.pb_size, tone_info.rate, d_rx_params.tone_mode);
         DEBUG_VECTOR(hard_demodulated_bits_ref);
 
         // Update stats with BER and number of bits
+        assert(hard_demodulated_bits.size() == hard_demodulated_bits_ref.size());
         int diff = 0;
-        for (size_t i=0; i<hard_demodulated_bits.size(); i++)
-            diff += (hard_demodulated_bits[i] != hard_demodulated_bits_ref[i]);
+        for (size_t i=0; i<hard_demodulated_bits.n_words(); i++)
+            diff += __builtin_popcountll(hard_demodulated_bits.words()[i] ^ hard_demodulated_bits_ref.words()[i]);
         stats.ber = (float)diff/hard_demodulated_bits.size();
         stats.n_bits = hard_demodulated_bits.size();
 
@@ -1097,50 +1546,87 @@ void phy_service::post_process_ppdu() {
     }
 }
 
+void phy_service::save_rx_frame_state(rx_frame_state_t &state) {
+    state.channel_response = d_channel_response;
+    state.noise_psd = d_noise_psd;
+    state.params = d_rx_params;
+    std::swap(state.payload_symbols_freq, d_rx_payload_symbols_freq);
+    std::swap(state.soft_bits, d_rx_soft_bits);
+    std::swap(state.mpdu_payload, d_rx_mpdu_payload);
+}
+
+void phy_service::restore_rx_frame_state(rx_frame_state_t &state) {
+    d_channel_response = state.channel_response;
+    d_noise_psd = state.noise_psd;
+    d_rx_params = state.params;
+    stats.noise_psd = d_noise_psd;
+    stats.channel = d_channel_response.carriers;
+    stats.tone_mode = d_rx_params.tone_mode;
+    std::swap(state.payload_symbols_freq, d_rx_payload_symbols_freq);
+    std::swap(state.soft_bits, d_rx_soft_bits);
+    std::swap(state.mpdu_payload, d_rx_mpdu_payload);
+}
+
 bool phy_service::process_ppdu_frame_control(vector_complex::const_iterator iter, unsigned char* mpdu_fc_bin) {
-    vector_int mpdu_fc_int;
-    if (process_ppdu_frame_control(iter, mpdu_fc_int) == true) {
+    bitstream_t &mpdu_fc = d_rx_workspace.mpdu_fc;
+    if (process_ppdu_frame_control(iter, mpdu_fc) == true) {
         if (mpdu_fc_bin != NULL)
-            pack_bitvector(mpdu_fc_int.begin(), mpdu_fc_int.end(), mpdu_fc_bin);
+            mpdu_fc.to_bytes(mpdu_fc_bin);
         return true;
     }
     return false;
 }
 
 bool phy_service::process_ppdu_frame_control(vector_complex::const_iterator iter, vector_int &mpdu_fc_int) {
+    bitstream_t mpdu_fc;
+    bool result = process_ppdu_frame_control(iter, mpdu_fc);
+    mpdu_fc_int = mpdu_fc.to_vector_int();
+    return result;
+}
+
+bool phy_service::process_ppdu_frame_control(vector_complex::const_iterator iter, bitstream_t &mpdu_fc) {
     // Resolve frame control symbol
     iter += IEEE1901_GUARD_INTERVAL_FC;
-    vector_complex fc_symbol_data(NUMBER_OF_CARRIERS);
+    vector_complex &fc_symbol_data = d_rx_workspace.fc_symbol;
+    fc_symbol_data.resize(NUMBER_OF_CARRIERS);
     vector_complex::iterator fc_symbol_data_iter = fc_symbol_data.begin();
     fc_symbol_data_iter = std::copy(iter, iter + NUMBER_OF_CARRIERS - ROLLOFF_INTERVAL, fc_symbol_data_iter);
     fc_symbol_data_iter = std::copy(iter - ROLLOFF_INTERVAL, iter, fc_symbol_data_iter);
     DEBUG_VECTOR(fc_symbol_data);
 
-    vector_complex fc_symbol_freq(NUMBER_OF_CARRIERS);
+    vector_complex &fc_symbol_freq = d_rx_workspace.fc_symbol_freq;
+    fc_symbol_freq.resize(NUMBER_OF_CARRIERS);
     fft(fc_symbol_data.begin(), fc_symbol_data.end(), fc_symbol_freq.begin());
     DEBUG_VECTOR(fc_symbol_freq);
 
     // Demodulate
-    vector_float fc_soft_bits = vector_float(BROADCAST_QPSK_TONE_INFO.capacity);
+    equalizer_t &equalizer = d_rx_workspace.fc_equalizer;
+    calc_equalizer(BROADCAST_QPSK_TONE_INFO.tone_map, d_channel_response, equalizer);
+    vector_float &fc_soft_bits = d_rx_workspace.fc_soft_bits;
+    fc_soft_bits.resize(BROADCAST_QPSK_TONE_INFO.capacity);
     vector_float::iterator fc_soft_bits_iter = fc_soft_bits.begin();
-    demodulate_symbols(fc_symbol_freq.begin(), fc_symbol_freq.end(), fc_soft_bits_iter, BROADCAST_QPSK_TONE_INFO.tone_map, d_channel_response);
+    demodulate_symbols(fc_symbol_freq.begin(), fc_symbol_freq.end(), fc_soft_bits_iter, equalizer);
     DEBUG_VECTOR(fc_soft_bits);
 
     // Undo the diversity copy
-    vector_float decopied = combine_copies(fc_soft_bits, FRAME_CONTROL_NBITS + 12/2, FRAME_CONTROL_NBITS*2 + 12); // +12/2 because of non standard turbo encoder
+    vector_float &decopied = d_rx_workspace.fc_decopied;
+    combine_copies(fc_soft_bits, FRAME_CONTROL_NBITS + 12/2, FRAME_CONTROL_NBITS*2 + 12, decopied); // +12/2 because of non standard turbo encoder
     DEBUG_VECTOR(decopied);
 
     // Undo channel interleaver
-    vector_float received_parity;
-    vector_float received_info = channel_deinterleaver(decopied, received_parity, PB16, RATE_1_2);
+    rx_lane_workspace_t &workspace = d_rx_workspace.lanes[0];
+    channel_deinterleaver(decopied.begin(), workspace.received_info, workspace.received_parity, PB16, RATE_1_2);
 
     // Decode
-    mpdu_fc_int = tc_decoder(received_info, received_parity, PB16, RATE_1_2);
-    DEBUG_VECTOR(mpdu_fc_int);
+    tc_decoder(workspace.received_info, workspace.received_parity, PB16, RATE_1_2, workspace.decoded_info);
+    mpdu_fc.assign(workspace.decoded_info);
+    DEBUG_VECTOR(mpdu_fc);
 
     // Determine parameters
     d_rx_params = rx_params_t();
-    bool result = get_rx_params(mpdu_fc_int, d_rx_params);
+    bool result = get_rx_params(mpdu_fc, d_rx_params);
+    if (result)
+        reset_payload_decoder(); // ready for process_ppdu_payload_symbol()
 
     // Update channel estimation params
     if (result)
@@ -1150,11 +1636,44 @@ bool phy_service::process_ppdu_frame_control(vector_complex::const_iterator iter
     return result;
 }
 
+int phy_service::fine_sync(vector_complex::const_iterator iter, int n_offsets) {
+    // Cross-correlate with the reference by overlap-save: a block of NUMBER_OF_CARRIERS samples gives the
+    // correlation at its first NUMBER_OF_CARRIERS - FINE_SYNC_REFERENCE_SIZE + 1 offsets without wrapping around
+    static const int N = NUMBER_OF_CARRIERS;
+    static const int STEP = N - FINE_SYNC_REFERENCE_SIZE + 1;
+    int n_samples = n_offsets - 1 + FINE_SYNC_REFERENCE_SIZE;
+    const vector_complex &reference_freq = SYNC_TABLES->fine_sync_reference_freq;
+    vector_complex &block = d_rx_workspace.sync_block, &block_freq = d_rx_workspace.sync_block_freq, &corr = d_rx_workspace.sync_corr;
+    block.resize(N);
+    block_freq.resize(N);
+    corr.resize(N);
+    int best_offset = 0;
+    float best_power = -1;
+    for (int offset = 0; offset < n_offsets; offset += STEP) {
+        int n = std::min(N, n_samples - offset);
+        std::copy(iter + offset, iter + offset + n, block.begin());
+        std::fill(block.begin() + n, block.end(), complex(0));
+        fft(block.begin(), block.end(), block_freq.begin());
+        for (int i = 0; i < N; i++)
+            block_freq[i] *= reference_freq[i];
+        ifft(block_freq.begin(), block_freq.end(), corr.begin());
+        for (int d = 0; d < STEP && offset + d < n_offsets; d++) {
+            float power = std::norm(corr[d]);
+            if (power > best_power) {
+                best_power = power;
+                best_offset = offset + d;
+            }
+        }
+    }
+    return best_offset;
+}
+
 void phy_service::process_noise(vector_complex::const_iterator iter_begin, vector_complex::const_iterator iter_end) {
     static const int N = NUMBER_OF_CARRIERS; // window length
     int M = iter_end - iter_begin; // total signal length
     int K = M / N; // number of windows fits in signal
-    vector_complex w_fft(N);
+    vector_complex &w_fft = d_rx_workspace.noise_freq;
+    w_fft.resize(N);
     d_noise_psd.fill(0); // init vector to zero
     for (int k=0; k<K; k++) {
         fft(iter_begin + k*N, iter_begin + k*N + N, w_fft.begin());
@@ -1167,6 +1686,27 @@ void phy_service::process_noise(vector_complex::const_iterator iter_begin, vecto
     return;
 }
 
+void phy_service::average_noise(vector_complex::const_iterator iter, float alpha) {
+    // Exponential average, so a running estimate can be kept from windows of noise as they arrive
+    static const int N = NUMBER_OF_CARRIERS; // window length
+    vector_complex &w_fft = d_rx_workspace.noise_freq;
+    w_fft.resize(N);
+    fft(iter, iter + N, w_fft.begin());
+    for (int i=0; i<N; i++)
+        d_noise_psd[i] += alpha * (std::norm(w_fft[i]) - d_noise_psd[i]);
+    stats.noise_psd = d_noise_psd;
+}
+
+const tones_float_t &phy_service::get_noise_psd() {
+    return d_noise_psd;
+}
+
+void phy_service::set_noise_psd(const tones_float_t &noise_psd) {
+    d_noise_psd = noise_psd;
+    stats.noise_psd = d_noise_psd;
+    DEBUG_VECTOR(d_noise_psd);
+}
+
  tone_map_t phy_service::calculate_tone_map(float P_t, tone_mask_t qpsk_force_mask) {
     // Calculating the SNR. The average received signal is NUMBER_OF_CARRIERS*H[k]
     tones_float_t snr;
@@ -1265,6 +1805,7 @@ void phy_service::set_tone_map(tone_map_t tone_map) {
     d_custom_tone_info.tone_map = tone_map;
     d_custom_tone_info.rate = RATE_1_2;
     update_tone_info_capacity(d_custom_tone_info);
+    update_tone_info_plan(d_custom_tone_info);
     DEBUG_VAR(d_custom_tone_info.capacity);
     for (size_t i=0; i<tone_map.size(); i++)
         d_qpsk_tone_mask[i] = (tone_map[i] == MT_QPSK);
@@ -1275,10 +1816,18 @@ int phy_service::get_mpdu_payload_size() {
 }
 
 int phy_service::get_ppdu_payload_length() {
-    return d_rx_params.n_symbols * (NUMBER_OF_CARRIERS + IEEE1901_GUARD_INTERVAL_PAYLOAD);
+    return d_rx_params.n_symbols * PAYLOAD_SYMBOL_SIZE;
+}
+
+int phy_service::max_ppdu_payload_length() {
+    // Number of symbols get_rx_params() calculates from the largest frame length
+    static_assert(IEEE1901_FRAME_CONTROL_SOF_FL_WIDTH == IEEE1901_FRAME_CONTROL_SOUND_FL_WIDTH, "SOF and sound frame lengths differ");
+    int fl_width = (1 << IEEE1901_FRAME_CONTROL_SOF_FL_WIDTH) - 1;
+    int n_symbols = (fl_width * 1.28 - IEEE1901_RIFS_DEFAULT - (float)IEEE1901_ROLLOFF_INTERVAL / SAMPLE_RATE) / ((NUMBER_OF_CARRIERS + (float)IEEE1901_GUARD_INTERVAL_PAYLOAD) / SAMPLE_RATE) + 0.5;
+    return n_symbols * PAYLOAD_SYMBOL_SIZE;
 }
 
-bool phy_service::get_rx_params (const vector_int &fc_bits, rx_params_t &rx_params) {
+bool phy_service::get_rx_params (const bitstream_t &fc_bits, rx_params_t &rx_params) {
     if (!crc24_check(fc_bits))
         return false;
     int fl_width = 0;
@@ -1336,7 +1885,7 @@ bool phy_service::get_rx_params (const vector_int &fc_bits, rx_params_t &rx_para
 
     // If this frame contains a payload, calculate these parameters
     if (rx_params.n_symbols > 0) {
-        tone_info_t tone_info = get_tone_info(rx_params.tone_mode);
+        const tone_info_t &tone_info = get_tone_info(rx_params.tone_mode);
         rx_params.fec_block_size = calc_fec_block_size(rx_params.tone_mode, tone_info.rate, rx_params.pb_size);
         rx_params.n_blocks = (rx_params.n_symbols - 1) * tone_info.capacity / rx_params.fec_block_size + 1;
     }
@@ -1344,22 +1893,81 @@ bool phy_service::get_rx_params (const vector_int &fc_bits, rx_params_t &rx_para
     return true;
 }
 
-bool phy_service::crc24_check(const vector_int &bit_vector) {
-    return (crc24(bit_vector) == 0x7FF01C); // The one's complement of 0x800FE3
-}
+bool phy_service::crc24_check(const bitstream_t &bitstream) {
+    return (crc24(bitstream, bitstream.size()) == 0x7FF01C); // The one's complement of 0x800FE3
+}
+
+void phy_service::calc_equalizer(const tone_map_t& tone_map, const channel_response_t &channel_response, equalizer_t &equalizer) {
+    // Group the active carriers by modulation, keeping the position of their soft bits in the symbol.
+    // The groups are counted first, so the vectors of equalizer are refilled in place
+    std::array<size_t, 10> group_size = {};
+    for (int i = 0; i < NUMBER_OF_CARRIERS; i++)
+        if (tone_map[i] != MT_NULLED)
+            group_size[tone_map[i]]++;
+    equalizer.group_begin[MT_NULLED] = 0;
+    for (int m = MT_NULLED; m <= MT_QAM4096; m++)
+        equalizer.group_begin[m + 1] = equalizer.group_begin[m] + group_size[m];
+    size_t n_carriers = equalizer.group_begin[MT_QAM4096 + 1];
+    equalizer.carriers.resize(n_carriers);
+    equalizer.soft_bit_offsets.resize(n_carriers);
+    equalizer.coefficients.resize(n_carriers);
+    equalizer.llr_scales.resize(n_carriers);
+    equalizer.values.resize(n_carriers);
+
+    std::array<size_t, 10> next = equalizer.group_begin;
+    int n_bits = 0;
+    for (int i = 0; i < NUMBER_OF_CARRIERS; i++) {
+        if (tone_map[i] == MT_NULLED)
+            continue;
+        size_t k = next[tone_map[i]]++;
+        complex h = channel_response.carriers[i] * (float)NUMBER_OF_CARRIERS;
+        complex p = ANGLE_NUMBER_TO_VALUE[CARRIERS_ANGLE_NUMBER[i]*2]; // Convert the angle number to its value
+        equalizer.carriers[k] = i;
+        equalizer.soft_bit_offsets[k] = n_bits;
+        equalizer.coefficients[k] = std::conj(p) / h; // Divide by the channel and rotate by minus angle_number
+        equalizer.llr_scales[k] = std::norm(h) / d_noise_psd[i];
+        n_bits += MODULATION_MAP[tone_map[i]].n_bits;
+    }
+    equalizer.n_bits = n_bits;
+}
+
+vector_float::iterator phy_service::demodulate_symbols (vector_complex::const_iterator iter, vector_complex::const_iterator iter_end, vector_float::iterator soft_bits_iter, equalizer_t &equalizer) {
+    assert((iter_end - iter) % NUMBER_OF_CARRIERS == 0);
+    size_t n_carriers = equalizer.carriers.size();
+    const int *carriers = equalizer.carriers.data();
+    const complex *coefficients = equalizer.coefficients.data();
+    complex *values = equalizer.values.data();
+    for (; iter != iter_end; iter += NUMBER_OF_CARRIERS) {
+        // Equalize the active carriers to get the original mapped values
+        const complex *symbol = &*iter;
+        for (size_t k = 0; k < n_carriers; k++) {
+            complex r = symbol[carriers[k]];
+            complex c = coefficients[k];
+            values[k] = complex(r.real() * c.real() - r.imag() * c.imag(), r.real() * c.imag() + r.imag() * c.real());
+        }
 
-vector_float::iterator phy_service::demodulate_symbols (vector_complex::const_iterator iter, vector_complex::const_iterator iter_end, vector_float::iterator soft_bits_iter, const tone_map_t& tone_map, const channel_response_t &channel_response) {
-    int i = 0;
-    while (iter != iter_end) {
-        if (tone_map[i] != MT_NULLED) {  // If carrier is ON
-            complex r = *iter / channel_response.carriers[i] / (float)NUMBER_OF_CARRIERS;
-            complex p = ANGLE_NUMBER_TO_VALUE[CARRIERS_ANGLE_NUMBER[i]*2]; // Convert the angle number to its value
-            complex mapped_value(r.real() * p.real() + r.imag() * p.imag(),
-                                             -r.real() * p.imag() + r.imag() * p.real()); // Rotate channel value by minus angel_number to get the original mapped value
-            soft_bits_iter = demodulate_soft_bits(mapped_value, tone_map[i], d_noise_psd[i] / std::norm(channel_response.carriers[i] * (float)NUMBER_OF_CARRIERS), soft_bits_iter);
+        // Demap the carriers of each modulation in one batch
+        float *soft_bits = &*soft_bits_iter;
+        for (int m = MT_BPSK; m <= MT_QAM4096; m++) {
+            size_t begin = equalizer.group_begin[m];
+            size_t n = equalizer.group_begin[m + 1] - begin;
+            if (n == 0)
+                continue;
+            const complex *v = values + begin;
+            const float *llr_scales = equalizer.llr_scales.data() + begin;
+            const int *offsets = equalizer.soft_bit_offsets.data() + begin;
+            switch (m) {
+                case MT_BPSK: demodulate_soft_bits<MT_BPSK, MAP_BPSK_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+                case MT_QPSK: demodulate_soft_bits<MT_QPSK, MAP_QPSK_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+                case MT_QAM8: demodulate_soft_bits<MT_QAM8, MAP_QAM8_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+                case MT_QAM16: demodulate_soft_bits<MT_QAM16, MAP_QAM16_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+                case MT_QAM64: demodulate_soft_bits<MT_QAM64, MAP_QAM64_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+                case MT_QAM256: demodulate_soft_bits<MT_QAM256, MAP_QAM256_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+                case MT_QAM1024: demodulate_soft_bits<MT_QAM1024, MAP_QAM1024_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+                case MT_QAM4096: demodulate_soft_bits<MT_QAM4096, MAP_QAM4096_NBITS>(v, llr_scales, offsets, n, soft_bits); break;
+            }
         }
-        i = (i + 1) % NUMBER_OF_CARRIERS;
-        iter++;
+        soft_bits_iter += equalizer.n_bits;
     }
     return soft_bits_iter;
 }
@@ -1371,73 +1979,169 @@ void phy_service::update_tone_info_capacity(tone_info_t& tone_info) {
         tone_info.capacity += MODULATION_MAP[tone_info.tone_map[i]].n_bits;
 }
 
-vector_float::iterator phy_service::demodulate_soft_bits(const complex &value, modulation_type_t modulation, float n0, vector_float::iterator iter) {
-    modulation_map_t modulation_map = MODULATION_MAP[modulation];
-    switch (modulation) {
-        case MT_NULLED: {
-            break;
-        }
-        case MT_BPSK: {
-            *iter++ = -4 * std::real(value) * modulation_map.scale / n0;
-            break;
+// Compile the tone map into the carrier lists used by modulate()
+void phy_service::update_tone_info_plan(tone_info_t& tone_info) {
+    modulation_plan_t plan;
+    plan.n_bits = 0;
+    for (int i = 0; i < NUMBER_OF_CARRIERS; i++) {
+        if (!TONE_MASK[i]) // if regulations do not allow the carrier to transmit
+            continue;
+        assert(CARRIERS_ANGLE_NUMBER[i] < N_CARRIER_ANGLES);
+        plan.tx_carriers.push_back(i);
+        modulation_type_t modulation = tone_info.tone_map[i];
+        if (modulation != MT_NULLED) {
+            plan.carriers[modulation].push_back(i);
+            plan.bit_offsets[modulation].push_back(plan.n_bits);
+            plan.n_bits += MODULATION_MAP[modulation].n_bits;
+        } else {
+            plan.off_carriers.push_back(i);
         }
-        case MT_QPSK: {
-            *iter++ = -4 * std::real(value) * modulation_map.scale / n0;
-            *iter++ = -4 * std::imag(value) * modulation_map.scale / n0;
-            break;
+    }
+    tone_info.plan = plan;
+}
+
+#if defined(__SSE2__)
+// demodulate_pam_soft_bits() for four carriers at once, without branches: the closest point and the runs
+// of each bit are found with integer arithmetic, the run edges the Gray mapping excludes are pushed out
+// of reach. Writes the soft bits of carrier j to llr[b][j]
+template <int N_BITS>
+static void demodulate_pam_soft_bits_x4(__m128 r, float scale, __m128 llr_scale, float (*llr)[4]) {
+    const int l = 1 << N_BITS;
+    const __m128 far = _mm_set1_ps(std::numeric_limits<float>::max());
+    const __m128 one = _mm_set1_ps(1);
+    const __m128i one_i = _mm_set1_epi32(1);
+    r = _mm_div_ps(r, _mm_set1_ps(scale));
+    __m128 k = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(_mm_add_ps(r, one), _mm_set1_ps(0.5f))));
+    k = _mm_sub_ps(_mm_add_ps(k, k), one); // closest constellation point
+    k = _mm_max_ps(_mm_set1_ps(1 - l), _mm_min_ps(k, _mm_set1_ps(l - 1))); // clip k if overflow
+    __m128i k_i = _mm_cvttps_epi32(k);
+    __m128i dec = _mm_and_si128(_mm_sub_epi32(_mm_set1_epi32(l), _mm_srai_epi32(_mm_add_epi32(k_i, one_i), 1)), _mm_set1_epi32(l - 1));
+    dec = _mm_xor_si128(dec, _mm_srli_epi32(dec, 1)); // as qam_demodulate()
+    __m128i q = _mm_srai_epi32(_mm_add_epi32(k_i, _mm_set1_epi32(l - 1)), 1);
+    __m128 d_closest = _mm_mul_ps(_mm_sub_ps(r, k), _mm_sub_ps(r, k));
+    __m128 scale2 = _mm_set1_ps(scale * scale);
+    for (int b = 0; b < N_BITS; b++) {
+        int run = 1 << b;
+        __m128 first = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(run)), _mm_set1_epi32(~(2*run - 1))), _mm_set1_epi32(run)));
+        __m128 run_begin = _mm_max_ps(first, _mm_setzero_ps());
+        __m128 run_end = _mm_min_ps(_mm_add_ps(first, _mm_set1_ps(2*run - 1)), _mm_set1_ps(l - 1));
+        __m128 dl = _mm_sub_ps(r, _mm_sub_ps(_mm_add_ps(run_begin, run_begin), _mm_set1_ps(l + 1)));
+        __m128 dr = _mm_sub_ps(r, _mm_sub_ps(_mm_add_ps(run_end, run_end), _mm_set1_ps(l - 3)));
+        __m128 left_edge = _mm_cmpeq_ps(run_begin, _mm_setzero_ps());
+        __m128 right_edge = _mm_cmpeq_ps(run_end, _mm_set1_ps(l - 1));
+        dl = _mm_or_ps(_mm_and_ps(left_edge, far), _mm_andnot_ps(left_edge, _mm_mul_ps(dl, dl)));
+        dr = _mm_or_ps(_mm_and_ps(right_edge, far), _mm_andnot_ps(right_edge, _mm_mul_ps(dr, dr)));
+        __m128 d = _mm_sub_ps(_mm_min_ps(dl, dr), d_closest); // d[other] - d[closest]
+        __m128 bit = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(dec, b), one_i), 31));
+        d = _mm_xor_ps(d, bit); // d[1] - d[0]
+        _mm_storeu_ps(llr[b], _mm_mul_ps(_mm_mul_ps(d, scale2), llr_scale));
+    }
+}
+#endif
+
+template <modulation_type_t MODULATION, int N_BITS>
+void phy_service::demodulate_soft_bits(const complex *values, const float *llr_scales, const int *soft_bit_offsets, size_t n, float *soft_bits) {
+    const float scale = MODULATION_MAP[MODULATION].scale;
+    size_t k = 0;
+#if defined(__SSE2__)
+    // Four carriers at a time: their soft bits are computed into llr, a row per bit, then scattered
+    // to the carriers' positions in the symbol
+    float llr[N_BITS][4];
+    const __m128 minus_4_scale = _mm_set1_ps(-4 * scale);
+    for (; k + 4 <= n; k += 4) {
+        __m128 v0 = _mm_loadu_ps(reinterpret_cast<const float *>(values + k));
+        __m128 v1 = _mm_loadu_ps(reinterpret_cast<const float *>(values + k + 2));
+        __m128 re = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 llr_scale = _mm_loadu_ps(llr_scales + k);
+        switch (MODULATION) { // resolved at compile time
+            case MT_BPSK: {
+                _mm_storeu_ps(llr[0], _mm_mul_ps(_mm_mul_ps(re, minus_4_scale), llr_scale));
+                break;
+            }
+            case MT_QPSK: {
+                _mm_storeu_ps(llr[0], _mm_mul_ps(_mm_mul_ps(re, minus_4_scale), llr_scale));
+                _mm_storeu_ps(llr[1], _mm_mul_ps(_mm_mul_ps(im, minus_4_scale), llr_scale));
+                break;
+            }
+            case MT_QAM8: {
+                demodulate_pam_soft_bits_x4<N_BITS - 1>(re, scale, llr_scale, llr);
+                _mm_storeu_ps(llr[N_BITS - 1], _mm_mul_ps(_mm_mul_ps(im, _mm_set1_ps(-4 * 1.29f * scale)), llr_scale));
+                break;
+            }
+            default: {
+                demodulate_pam_soft_bits_x4<N_BITS / 2>(re, scale, llr_scale, llr);
+                demodulate_pam_soft_bits_x4<N_BITS / 2>(im, scale, llr_scale, llr + N_BITS / 2);
+                break;
+            }
         }
-        case MT_QAM8: {
-            iter = demodulate_soft_bits_helper(modulation_map.n_bits-1, std::real(value), modulation_map.scale, n0, iter);
-            *iter++ = -4 * std::imag(value) * 1.29 * modulation_map.scale / n0;
-            break;
+        for (int j = 0; j < 4; j++) {
+            float *out = soft_bits + soft_bit_offsets[k + j];
+            for (int b = 0; b < N_BITS; b++)
+                out[b] = llr[b][j];
         }
-        case MT_QAM16:
-        case MT_QAM64:
-        case MT_QAM256:
-        case MT_QAM1024:
-        case MT_QAM4096: {
-            iter = demodulate_soft_bits_helper(modulation_map.n_bits/2, std::real(value), modulation_map.scale, n0, iter);
-            iter = demodulate_soft_bits_helper(modulation_map.n_bits/2, std::imag(value), modulation_map.scale, n0, iter);
-            break;
+    }
+#endif
+    // The remaining carriers one by one
+    for (; k < n; k++) {
+        float *out = soft_bits + soft_bit_offsets[k];
+        float llr_scale = llr_scales[k];
+        switch (MODULATION) { // resolved at compile time
+            case MT_BPSK: {
+                out[0] = -4 * std::real(values[k]) * scale * llr_scale;
+                break;
+            }
+            case MT_QPSK: {
+                out[0] = -4 * std::real(values[k]) * scale * llr_scale;
+                out[1] = -4 * std::imag(values[k]) * scale * llr_scale;
+                break;
+            }
+            case MT_QAM8: {
+                out = demodulate_pam_soft_bits<N_BITS - 1>(std::real(values[k]), scale, llr_scale, out);
+                *out = -4 * std::imag(values[k]) * 1.29 * scale * llr_scale;
+                break;
+            }
+            default: {
+                out = demodulate_pam_soft_bits<N_BITS / 2>(std::real(values[k]), scale, llr_scale, out);
+                demodulate_pam_soft_bits<N_BITS / 2>(std::imag(values[k]), scale, llr_scale, out);
+                break;
+            }
         }
     }
-
-    return iter;
 }
-vector_float::iterator phy_service::demodulate_soft_bits_helper(int n_bits, float r, float scale, float n0, vector_float::iterator iter) {
+
+template <int N_BITS>
+float *phy_service::demodulate_pam_soft_bits(float r, float scale, float llr_scale, float *out) {
+    // Max-log LLR of each bit: the distance to the closest point k against the distance to the closest
+    // point with the other bit value. In the Gray mapping bit b only changes between the PAM positions
+    // q-1 and q where q = 2^b modulo 2^(b+1), so the latter is one of the points just outside k's run
+    const int l = 1 << N_BITS;
     r = r / scale;
-    int l = 1<<n_bits;
     int k = std::round((r+1)/2)*2-1; // find the closest constellation point
     k = std::max(1-l, std::min(k, l-1)); // clip k if overflow
-    for (int b = 0; b < n_bits; b++) {
+    int dec = qam_demodulate(k, l);
+    int q = (k + l - 1) / 2; // position of k, counting from the leftmost point
+    float d_closest = (r-k)*(r-k);
+    for (int b = 0; b < N_BITS; b++) {
+        int run = 1 << b;
+        int first = ((q + run) & ~(2*run - 1)) - run; // first position of k's run, before the leftmost point for the first run
+        int run_begin = std::max(first, 0);
+        int run_end = std::min(first + 2*run - 1, l - 1);
+        int i_left = 2*(run_begin - 1) - (l - 1);
+        int i_right = 2*(run_end + 1) - (l - 1);
+        float d_other;
+        if (run_begin == 0)
+            d_other = (r-i_right)*(r-i_right);
+        else if (run_end == l - 1)
+            d_other = (r-i_left)*(r-i_left);
+        else
+            d_other = std::min((r-i_right)*(r-i_right), (r-i_left)*(r-i_left));
         float d[2];
-        for (int z=0; z<=1; z++) {
-            int i_right = r + 2 * l;
-            int i_left = r - 2 * l;
-            // scan to the right and look for bit z (0 or 1)
-            for (int i=k; i<=l-1; i+=2) {
-                int dec = qam_demodulate(i,l);
-                // if found the bit, calculate the distance and break
-                if (((dec >> b) & 0x1) == z) {
-                    i_right = i;
-                    break;
-                }
-            }
-
-            // scan to the left and look for bit z (0 or 1)
-            for (int i=k-2; i>=1-l; i-=2) {
-                int dec = qam_demodulate(i,l);// l-(i+1)/2) % l;
-                // if found the bit, calculate the distance and break
-                if (((dec >> b) & 0x1) == z) {
-                    i_left = i;
-                    break;
-                }
-            }
-            d[z] = std::min((r-i_right)*(r-i_right), (r-i_left)*(r-i_left)); // take the minimum
-        }
-        *iter++ = (d[1] - d[0]) * scale * scale / n0;
+        d[(dec >> b) & 0x1] = d_closest;
+        d[((dec >> b) & 0x1) ^ 1] = d_other;
+        *out++ = (d[1] - d[0]) * scale * scale * llr_scale;
     }
-    return iter;
+    return out;
 }
 
 inline int phy_service::qam_demodulate(int v, int l) {
@@ -1450,165 +2154,72 @@ inline int phy_service::qam_demodulate(int v, int l) {
     return (decimal >> 1) ^ decimal;
 }
 
-vector_float phy_service::combine_copies(vector_float& bitstream, int offset, int n_bits) {
+void phy_service::combine_copies(const vector_float& bitstream, int offset, int n_bits, vector_float &out) {
     /* copier should replicate and interleave the 256 bits as follows:
        Original bit number order (k): 0   1   2   3   4   5   6 ... 254 255 0   1   2   3   4   5   ... 254 255 ...
                            New order: 0   128 1   129 2   130 3 ... 127 255 128 0   129 1   130 2   ... 255 128 ...
                             Location: 0   1   2   3   4   5   6 ... 254 255 256 257 258 259 260 261 ... 510 511 ... n_carriers*2
     */
 
-    vector_float decopier_output(n_bits, 0);
+    out.assign(n_bits, 0);
     for (unsigned int i = 0; i<bitstream.size()/2; i++) {
         // These are soft bits. Their combined value is their sum
-        decopier_output[i % n_bits] += bitstream[i*2];
-        decopier_output[(i+offset) % n_bits] += bitstream[i*2+1];
-    }
-
-    return decopier_output;
-}
-
-vector_float phy_service::channel_deinterleaver(const vector_float& bitstream, vector_float& parity_bitstream, pb_size_t pb_size, code_rate_t rate) {
-    int step_size = CHANNEL_INTERLEAVER_STEPSIZE[pb_size][rate];
-    int offset = CHANNEL_INTERLEAVER_OFFSET[pb_size][rate];
-    int info_row_no = 0;
-    int n_info_rows_done = 0;
-    int n_parity_rows_done = 0;
-    int parity_row_no = offset;
-    bool parity_done = false, info_done = false;
-    int size = bitstream.size();
-    int nibble_no = 0;
-    vector_float::const_iterator iter = bitstream.begin();
-    vector_float info_bitstream;
-
-    switch (rate) {
-    case RATE_1_2: {
-        info_bitstream = vector_float((size - 12) / 2); //  adjusted due to non standard turbo encoder...
-        parity_bitstream = vector_float(size - info_bitstream.size());
-
-        while (!info_done || !parity_done) {
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            parity_done = channel_deinterleaver_row(iter, parity_bitstream, step_size, parity_row_no, n_parity_rows_done, nibble_no);
-        }
-        break;
-    }
-
-    case RATE_16_21: {
-        info_bitstream = vector_float(size * 16 / 21);
-        parity_bitstream = vector_float(size * 5 / 21);
-        while (!info_done && !parity_done) {
-            for (int i=0; i<5; i++) {
-                info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-                info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-                info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-                parity_done = channel_deinterleaver_row(iter, parity_bitstream, step_size, parity_row_no, n_parity_rows_done, nibble_no, true);
-            }
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-        }
-        break;
-    }
-
-    case RATE_16_18: {
-        info_bitstream = vector_float(size * 16 / 18);
-        parity_bitstream = vector_float(size * 2 / 18);
-        while (!info_done && !parity_done) {
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            parity_done = channel_deinterleaver_row(iter, parity_bitstream, step_size, parity_row_no, n_parity_rows_done, nibble_no, true);
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-            info_done = channel_deinterleaver_row(iter, info_bitstream, step_size, info_row_no, n_info_rows_done, nibble_no);
-        }
-        break;
-    }
-    }
-    return info_bitstream;
-}
-
-bool phy_service::channel_deinterleaver_row(vector_float::const_iterator& iter, vector_float& out, int step_size, int& row_no, int& rows_done, int& nibble_no, bool wrap) {
-    int n_rows = out.size()/4;
-    if (rows_done < n_rows) {
-         // Reading a row
-        for (int i = nibble_no / 2; i < (nibble_no / 2) + 4 ; i++, iter++)
-            out[row_no + (i % 4) * n_rows] = *iter;
-        rows_done++;
-        nibble_no = (nibble_no + 1) % 8;
-
-        // Calculating the next row number
-        if (wrap || (row_no + step_size < n_rows))
-            row_no = (row_no + step_size) % n_rows;
+        out[i % n_bits] += bitstream[i*2];
+        out[(i+offset) % n_bits] += bitstream[i*2+1];
+    }
+}
+
+void phy_service::channel_deinterleaver(vector_float::const_iterator iter, vector_float& info_bitstream, vector_float& parity_bitstream, pb_size_t pb_size, code_rate_t rate) {
+    const vector_int &sequence = channel_interleaver_tables().deinterleaver_sequence[pb_size][rate];
+    assert(!sequence.empty());
+    int n_info = calc_phy_block_size(pb_size);
+    info_bitstream.resize(n_info);
+    parity_bitstream.resize(sequence.size() - n_info);
+
+    // Bits the interleaver never sent (index -1) are erasures
+    const float *in = &*iter;
+    const int *info_sequence = sequence.data();
+    const int *parity_sequence = sequence.data() + n_info;
+    for (int i = 0; i < n_info; i++)
+        info_bitstream[i] = info_sequence[i] < 0 ? 0 : in[info_sequence[i]];
+    for (unsigned int i = 0; i < parity_bitstream.size(); i++)
+        parity_bitstream[i] = parity_sequence[i] < 0 ? 0 : in[parity_sequence[i]];
+}
+
+void phy_service::robo_channel_deinterleaver(vector_float::const_iterator iter, vector_float& info_bitstream, vector_float& parity_bitstream, tone_mode_t tone_mode, pb_size_t pb_size, code_rate_t rate) {
+    const vector_int &sequence = ROBO_TABLES->deinterleaver_sequence[tone_mode][pb_size];
+    size_t n_bits = channel_interleaver_tables().deinterleaver_sequence[pb_size][rate].size();
+    assert(!sequence.empty() && n_bits && sequence.size() % n_bits == 0); // ROBO frames are always rate 1/2
+    int n_copies = sequence.size() / n_bits;
+    int n_info = calc_phy_block_size(pb_size);
+    info_bitstream.resize(n_info);
+    parity_bitstream.resize(n_bits - n_info);
+
+    // Each deinterleaved soft bit is the sum of its n_copies copies. The copies of an erased bit are all -1
+    const float *in = &*iter;
+    const int *index = sequence.data();
+    for (size_t i = 0; i < n_bits; i++, index += n_copies) {
+        float sum = 0;
+        if (index[0] >= 0)
+            for (int k = 0; k < n_copies; k++)
+                sum += in[index[k]];
+        if (i < (size_t)n_info)
+            info_bitstream[i] = sum;
         else
-            row_no = (row_no % step_size) + 1;
+            parity_bitstream[i - n_info] = sum;
     }
-    if (rows_done == n_rows)
-        return true;
-    return false;
-}
-
-vector_float phy_service::robo_deinterleaver(const vector_float& bitstream, int n_raw, tone_mode_t tone_mode)  {
-    unsigned int n_copies, bits_in_last_symbol, bits_in_segment, n_pad;
-    calc_robo_parameters (tone_mode, n_raw, n_copies, bits_in_last_symbol, bits_in_segment, n_pad);
-    assert (bitstream.size() % n_copies == 0); // input should have exactly n_copies of n_raw+n_pad
-    // Set the bits shift parameters
-    std::vector<int> cycle_shifts(n_copies,0);
-    int l = (bits_in_last_symbol - 1) / bits_in_segment;
-    switch (n_copies) {
-        case 2:  // l \in {0,1}
-            if (l==1)
-                cycle_shifts = {0,1};
-            break;
-        case 4:  // l \in {0,1,2,3}
-            if (l==1)
-                cycle_shifts = {0,0,1,1};
-            else if (l==3)
-                cycle_shifts = {0,1,2,3};
-            break;
-        case 5:  // l \in {0,1,2,3,4}
-            if (l==4)
-                cycle_shifts = {0,1,2,3,4};
-            break;
-    }
-
-    // Combine robo copies
-    vector_float combined_copy(n_raw);
-    vector_float::const_iterator it = bitstream.begin();
-    for (unsigned int k=0; k<n_copies; k++) {
-
-        // Each copy is arranged as follows:
-        // [part 2: n_shifted] [n_pad] [part 1: n_raw-n_shifted]
-        // Only the first and last part are actual data bits.
-        // If n_shifted is zero than it is arranged as follows:
-        // [n_raw] [n_pad]
-
-        vector_float::iterator combined_copy_iter = combined_copy.begin();
-        // Since the bits are soft bits, we add all copies to a combined soft bit
-        if (cycle_shifts[k] == 0)
-            combined_copy_iter = std::transform (it, it + n_raw, combined_copy_iter, combined_copy_iter, std::plus<float>());
-        else {
-            int start_position = cycle_shifts[k] * bits_in_segment;
-            combined_copy_iter = std::transform (it + start_position, it + n_raw + n_pad, combined_copy_iter, combined_copy_iter, std::plus<float>());
-            combined_copy_iter = std::transform (it, it + start_position - n_pad, combined_copy_iter, combined_copy_iter, std::plus<float>());
-        }
-        it += n_raw + n_pad;
-    }
-    return combined_copy;
 }
 
 int phy_service::calc_fec_block_size(tone_mode_t tone_mode, code_rate_t rate, pb_size_t pb_size) {
-    int encoded_pb_n_bits = calc_encoded_block_size(rate, pb_size);
+    if (tone_mode == TM_NO_ROBO)
+        return calc_encoded_block_size(rate, pb_size);
 
-    // Determine parameters for ROBO mode
-    unsigned int n_copies = 1, n_pad = 0, bits_in_last_symbol, bits_in_segment; // default values when not in ROBO mode
-    if (tone_mode != TM_NO_ROBO) {
-        calc_robo_parameters (tone_mode, encoded_pb_n_bits, n_copies, bits_in_last_symbol, bits_in_segment, n_pad);
-        return (encoded_pb_n_bits + n_pad) * n_copies;
-    }
-    return encoded_pb_n_bits;
+    // ROBO modes have a fixed rate, their block sizes with the copies and padding are tabulated
+    assert (rate == ROBO_TABLES->tone_info[tone_mode].rate && (pb_size == PB520 || pb_size == PB136));
+    return ROBO_TABLES->fec_block_size[tone_mode][pb_size];
 }
 
-inline int phy_service::calc_phy_block_size(pb_size_t pb_size) {
+int phy_service::calc_phy_block_size(pb_size_t pb_size) {
     if (pb_size == PB520)
         return 520*8;
     else if (pb_size == PB136)
@@ -1634,7 +2245,7 @@ int phy_service::max_blocks (tone_mode_t tone_mode) {
     static const float SYMBOL_DURARION = (NUMBER_OF_CARRIERS + (float)IEEE1901_GUARD_INTERVAL_PAYLOAD + (float)IEEE1901_ROLLOFF_INTERVAL) / SAMPLE_RATE; // one symbol duration (microseconds)
     static const float MAX_FRAME_DURATION = ((1 << IEEE1901_FRAME_CONTROL_SOF_FL_WIDTH) - 1) * 1.28 - IEEE1901_RIFS_DEFAULT; // maximum of all symbols duration allowed (microseconds)
     static const int MAX_N_SYMBOLS = MAX_FRAME_DURATION / SYMBOL_DURARION; // maximum number of symbols
-    tone_info_t tone_info = get_tone_info(tone_mode);
+    const tone_info_t &tone_info = get_tone_info(tone_mode);
     int encoded_pb_n_bits = calc_fec_block_size(tone_mode, tone_info.rate, PB520);
     int max_n_bits = MAX_N_SYMBOLS * tone_info.capacity; // maximum number of bits
     return max_n_bits / encoded_pb_n_bits; // maximum number of PB520 blocks
@@ -1646,50 +2257,82 @@ phy_service::tone_info_t phy_service::build_broadcast_tone_info(modulation_type_
         broadcast_carriers.tone_map[i] = BROADCAST_TONE_MASK[i] ? modulation : MT_NULLED;
     broadcast_carriers.rate = RATE_1_2;
     update_tone_info_capacity(broadcast_carriers);
+    update_tone_info_plan(broadcast_carriers);
     return broadcast_carriers;
 }
 
 void phy_service::create_fftw_vars () {
-    std::lock_guard<std::mutex> lck (fftw_mtx); // lock this part since fftw plan creation is not thread safe
+    fftw_plans(); // the first instance creates the shared plans
 
-    // Create fftw3 plan (used by fft and ifft routine)
+    // Buffers have the alignment of fftwf_alloc_complex, like the ones the plans were created on
     d_ifft_input = fftwf_alloc_complex(NUMBER_OF_CARRIERS);
     d_ifft_output = fftwf_alloc_complex(NUMBER_OF_CARRIERS);
-    d_fftw_rev_plan = fftwf_plan_dft_1d (NUMBER_OF_CARRIERS,
-                                            d_ifft_input,
-                                            d_ifft_output,
-                                            FFTW_BACKWARD,
-                                            FFTW_MEASURE);
-
     d_fft_input = fftwf_alloc_complex(NUMBER_OF_CARRIERS);
     d_fft_output = fftwf_alloc_complex(NUMBER_OF_CARRIERS);
-    d_fftw_fwd_plan = fftwf_plan_dft_1d (NUMBER_OF_CARRIERS,
-                                            d_fft_input,
-                                            d_fft_output,
-                                            FFTW_FORWARD,
-                                            FFTW_MEASURE);
-
+    d_ifft_batch_input = fftwf_alloc_complex(NUMBER_OF_CARRIERS * FFT_BATCH_SIZE);
+    d_ifft_batch_output = fftwf_alloc_complex(NUMBER_OF_CARRIERS * FFT_BATCH_SIZE);
+    d_fft_batch_input = fftwf_alloc_complex(NUMBER_OF_CARRIERS * FFT_BATCH_SIZE);
+    d_fft_batch_output = fftwf_alloc_complex(NUMBER_OF_CARRIERS * FFT_BATCH_SIZE);
     d_ifft_syncp_input = fftwf_alloc_complex(SYNCP_SIZE);
     d_ifft_syncp_output = fftwf_alloc_complex(SYNCP_SIZE);
-    d_fftw_syncp_rev_plan = fftwf_plan_dft_1d (SYNCP_SIZE,
-                                            d_ifft_syncp_input,
-                                            d_ifft_syncp_output,
-                                            FFTW_BACKWARD,
-                                            FFTW_MEASURE);
-
     d_fft_syncp_input = fftwf_alloc_complex(SYNCP_SIZE);
     d_fft_syncp_output = fftwf_alloc_complex(SYNCP_SIZE);
-    d_fftw_syncp_fwd_plan = fftwf_plan_dft_1d (SYNCP_SIZE,
-                                            d_fft_syncp_input,
-                                            d_fft_syncp_output,
+}
+
+const phy_service::fftw_plans_t &phy_service::fftw_plans() {
+    static const fftw_plans_t plans = create_fftw_plans();
+    return plans;
+}
+
+phy_service::fftw_plans_t phy_service::create_fftw_plans() {
+    std::lock_guard<std::mutex> lck (fftw_mtx); // lock this part since fftw plan creation is not thread safe
+
+    std::string wisdom_file = fftw_wisdom_file;
+    if (wisdom_file.empty() && std::getenv("GR_PLC_FFTW_WISDOM"))
+        wisdom_file = std::getenv("GR_PLC_FFTW_WISDOM");
+    // Plans found in the wisdom are created without measuring again, a missing file is not an error
+    if (!wisdom_file.empty())
+        fftwf_import_wisdom_from_filename(wisdom_file.c_str());
+
+    // Plans are created out of place on scratch buffers and executed with fftwf_execute_dft on the instance buffers
+    fftw_plans_t plans;
+    const int n = NUMBER_OF_CARRIERS;
+    fftwf_complex *input = fftwf_alloc_complex(NUMBER_OF_CARRIERS * FFT_BATCH_SIZE);
+    fftwf_complex *output = fftwf_alloc_complex(NUMBER_OF_CARRIERS * FFT_BATCH_SIZE);
+    plans.rev = fftwf_plan_dft_1d (NUMBER_OF_CARRIERS, input, output, FFTW_BACKWARD, FFTW_MEASURE);
+    plans.fwd = fftwf_plan_dft_1d (NUMBER_OF_CARRIERS, input, output, FFTW_FORWARD, FFTW_MEASURE);
+
+    // Batched plans, transforming FFT_BATCH_SIZE consecutive symbols in one call
+    plans.rev_batch = fftwf_plan_many_dft (1, &n, FFT_BATCH_SIZE,
+                                            input, NULL, 1, NUMBER_OF_CARRIERS,
+                                            output, NULL, 1, NUMBER_OF_CARRIERS,
+                                            FFTW_BACKWARD,
+                                            FFTW_MEASURE);
+    plans.fwd_batch = fftwf_plan_many_dft (1, &n, FFT_BATCH_SIZE,
+                                            input, NULL, 1, NUMBER_OF_CARRIERS,
+                                            output, NULL, 1, NUMBER_OF_CARRIERS,
                                             FFTW_FORWARD,
                                             FFTW_MEASURE);
+
+    plans.syncp_rev = fftwf_plan_dft_1d (SYNCP_SIZE, input, output, FFTW_BACKWARD, FFTW_MEASURE);
+    plans.syncp_fwd = fftwf_plan_dft_1d (SYNCP_SIZE, input, output, FFTW_FORWARD, FFTW_MEASURE);
+    fftwf_free(input);
+    fftwf_free(output);
+
+    if (!wisdom_file.empty())
+        fftwf_export_wisdom_to_filename(wisdom_file.c_str());
+    return plans;
+}
+
+void phy_service::set_fftw_wisdom_file(const std::string &filename) {
+    std::lock_guard<std::mutex> lck (fftw_mtx);
+    fftw_wisdom_file = filename;
 }
 
 vector_complex::iterator phy_service::fft_syncp(vector_complex::const_iterator iter_begin, vector_complex::const_iterator iter_end, vector_complex::iterator iter_out) {
     assert (iter_end - iter_begin ==  SYNCP_SIZE);
     std::copy(iter_begin, iter_end, (complex*)d_fft_syncp_input);
-    fftwf_execute(d_fftw_syncp_fwd_plan);
+    fftwf_execute_dft(fftw_plans().syncp_fwd, d_fft_syncp_input, d_fft_syncp_output);
     // Unwrap the carriers by N/2, 1st carrier becomes N/2  and so on...
     iter_out = std::copy((complex*)d_fft_syncp_output + SYNCP_SIZE / 2, (complex*)d_fft_syncp_output + SYNCP_SIZE, iter_out);
     iter_out = std::copy((complex*)d_fft_syncp_output, (complex*)d_fft_syncp_output + SYNCP_SIZE / 2, iter_out);
@@ -1701,7 +2344,7 @@ vector_complex::iterator phy_service::ifft_syncp(vector_complex::const_iterator
     // Wrap the carriers by N/2, so N/2 carrier becomes first and so on...
     std::copy(iter_begin + SYNCP_SIZE / 2, iter_end, (complex*)d_ifft_syncp_input);
     std::copy(iter_begin, iter_begin + SYNCP_SIZE / 2, (complex*)d_ifft_syncp_input + SYNCP_SIZE / 2);
-    fftwf_execute(d_fftw_syncp_rev_plan);
+    fftwf_execute_dft(fftw_plans().syncp_rev, d_ifft_syncp_input, d_ifft_syncp_output);
     iter_out = std::copy ((complex*)d_ifft_syncp_output, (complex*)d_ifft_syncp_output + SYNCP_SIZE, iter_out);
     return iter_out;
 }
@@ -1712,17 +2355,19 @@ void phy_service::process_ppdu_preamble(vector_complex::const_iterator iter, vec
     auto iter_1 = iter + SYNCP_SIZE / 2 + 3 * SYNCP_SIZE; // SYNCP between [3.5-4.5]
     auto iter_2 = iter + SYNCP_SIZE / 2 + 4 * SYNCP_SIZE; // SYNCP between [4.5-5.5]
     auto iter_3 = iter + SYNCP_SIZE / 2 + 5 * SYNCP_SIZE; // SYNCP between [5.5-6.5]
-    vector_complex syncp_avg(SYNCP_SIZE);
+    vector_complex &syncp_avg = d_rx_workspace.syncp_avg;
+    syncp_avg.resize(SYNCP_SIZE);
     for (auto avg_iter = syncp_avg.begin(); avg_iter!=syncp_avg.end(); avg_iter++) // average all 3 SYNCPs
         *avg_iter = (*iter_1++ + *iter_2++ + *iter_3++) / (float)3;
     DEBUG_VECTOR(syncp_avg);
 
-    vector_complex syncp_freq(SYNCP_SIZE);
+    vector_complex &syncp_freq = d_rx_workspace.syncp_freq;
+    syncp_freq.resize(SYNCP_SIZE);
     fft_syncp(syncp_avg.begin(), syncp_avg.end(), syncp_freq.begin());
     DEBUG_VECTOR(syncp_freq);
 
     d_channel_response.n_syncp_symbols = 3; // set number of syncp symbols in channel response calculation
-    estimate_channel_syncp(syncp_freq.begin(), syncp_freq.end(), SYNCP_FREQ.begin(), d_channel_response);
+    estimate_channel_syncp(syncp_freq.begin(), syncp_freq.end(), SYNC_TABLES->syncp_freq.begin(), d_channel_response);
     stats.channel = d_channel_response.carriers;
     DEBUG_VECTOR(d_channel_response.carriers);
     return;
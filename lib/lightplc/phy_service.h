@@ -22,13 +22,21 @@
 #include <cstring>
 #include <fftw3.h>
 #include <itpp/itcomm.h>
+#include <memory>
 #include <mutex>
+#include <string>
 #include "defs.h"
+#include "turbo_codec.h"
+#include "bitstream.h"
+#include "thread_pool.h"
+
+class qa_phy_service;
 
 namespace light_plc {
 
 class phy_service
 {
+    friend class ::qa_phy_service; // checks the private encoder against IT++
 
 private:
     enum delimiter_type_t {
@@ -55,12 +63,31 @@ private:
         int n_syncp_symbols;
     } channel_response_t;
 
+    typedef struct modulation_plan_t {
+        std::array<vector_int, 9> carriers; // [modulation] carriers using this modulation
+        std::array<vector_int, 9> bit_offsets; // [modulation] position of each carrier's bits in the symbol
+        vector_int off_carriers; // carriers transmitting random BPSK filler
+        vector_int tx_carriers; // all carriers allowed by the tone mask
+        unsigned int n_bits; // data bits per symbol
+    } modulation_plan_t;
+
     typedef struct tone_info_t {
         tone_map_t tone_map;
         unsigned int capacity;
         code_rate_t rate;
+        modulation_plan_t plan;
     } tone_info_t;
 
+    typedef struct equalizer_t {
+        vector_int carriers; // active carriers, grouped by modulation
+        std::array<size_t, 10> group_begin; // [modulation] first carrier of the group, [MT_QAM4096+1] = end
+        vector_int soft_bit_offsets; // position of the carrier's soft bits in the symbol
+        vector_complex coefficients; // 1/(H*N) rotated by minus the carrier angle
+        vector_float llr_scales; // 1/n0 of the equalized value
+        vector_complex values; // equalized values of the current symbol
+        int n_bits; // soft bits per symbol
+    } equalizer_t;
+
     typedef struct tx_params_t {
         tone_mode_t tone_mode;
         pb_size_t pb_size;
@@ -98,6 +125,13 @@ private:
     static const int N_SYNC_CARRIERS = IEEE1901_SYNCP_SIZE;
     static const modulation_map_t MODULATION_MAP[9];
     static const complex ANGLE_NUMBER_TO_VALUE[16];
+    static const int N_CARRIER_ANGLES = 8;
+    static const int PN_PERIOD = 1023;
+    typedef std::array<std::array<vector_complex, N_CARRIER_ANGLES>, 9> rotated_maps_t; // [modulation][carrier angle number][decimal]
+    typedef struct pn_table_t {
+        std::array<int, PN_PERIOD> value; // pn_generator() output of each step
+        std::array<complex, PN_PERIOD> filler; // BPSK value of each step's bit
+    } pn_table_t;
     bool d_debug;
     tone_mask_t TONE_MASK;
     tone_mask_t BROADCAST_TONE_MASK;
@@ -106,19 +140,62 @@ private:
     int N_SYNC_ACTIVE_TONES;
     tone_mask_t SYNC_TONE_MASK_EXPANDED;
     tone_info_t BROADCAST_QPSK_TONE_INFO;
-    tone_info_t TONE_INFO_STD_ROBO;
-    tone_info_t TONE_INFO_MINI_ROBO;
-    tone_info_t TONE_INFO_HS_ROBO;
-    vector_complex PREAMBLE;
-    vector_complex SYNCP_FREQ;
-    std::array<vector_int, 3> TURBO_INTERLEAVER_SEQUENCE;
+    typedef struct channel_interleaver_tables_t {
+        std::array<std::array<vector_int, 3>, 3> interleaver_sequence; // [pb_size][rate], interleaved bit i is source bit [i]
+        std::array<std::array<vector_int, 3>, 3> deinterleaver_sequence; // [pb_size][rate], source bit i is interleaved bit [i]
+    } channel_interleaver_tables_t;
+    // Tables that only depend on the sync tone mask, shared by the instances with the same mask
+    typedef struct sync_tables_t {
+        vector_complex preamble;
+        vector_complex syncp_freq;
+        vector_complex fine_sync_reference_freq; // conjugate spectrum of the fine sync reference, zero padded
+    } sync_tables_t;
+    // Tables that only depend on the tone mask and the broadcast tone mask, shared by the instances with the same masks
+    typedef struct robo_tables_t {
+        std::array<tone_info_t, 3> tone_info; // [tone_mode]
+        std::array<std::array<int, 3>, 3> fec_block_size; // [tone_mode][pb_size], at the rate of the tone mode
+        std::array<std::array<vector_int, 3>, 3> deinterleaver_sequence; // [tone_mode][pb_size], FEC block positions of the copies of source bit i
+    } robo_tables_t;
+    std::shared_ptr<const sync_tables_t> SYNC_TABLES;
+    std::shared_ptr<const robo_tables_t> ROBO_TABLES;
 
 public:
+    // A prepared PPDU, its samples are produced by generate_ppdu()
+    typedef struct tx_state_t {
+        tx_params_t params;
+        tone_info_t tone_info;
+        bitstream_t mpdu_fc;
+        bitstream_t encoded_payload;
+        size_t length; // PPDU length in samples
+        size_t n_symbols; // payload symbols
+        size_t bit_pos; // next encoded bit to modulate
+        int pn_step; // PN generator step of the next filler carrier
+        vector_complex symbols_freq, symbols; // current batch of payload symbols
+        size_t batch_offset, batch_size;
+        vector_complex segment, next_segment; // windowed samples of the current preamble/symbol
+        int segment_index; // 0 = preamble, 1 = frame control, 2... = payload symbols
+        size_t segment_offset; // next sample of the segment to output
+    } tx_state_t;
+
+    // The state of a received PPDU that post_process_ppdu() and calculate_tone_map() work on
+    typedef struct rx_frame_state_t {
+        channel_response_t channel_response;
+        tones_float_t noise_psd;
+        rx_params_t params;
+        vector_complex payload_symbols_freq;
+        vector_float soft_bits;
+        bitstream_t mpdu_payload;
+    } rx_frame_state_t;
+
     static const int SYNCP_SIZE = IEEE1901_SYNCP_SIZE;
     static const int PREAMBLE_SIZE = SYNCP_SIZE * 10;
     static const int FRAME_CONTROL_SIZE = NUMBER_OF_CARRIERS + IEEE1901_GUARD_INTERVAL_FC;
+    static const int PAYLOAD_SYMBOL_SIZE = NUMBER_OF_CARRIERS + IEEE1901_GUARD_INTERVAL_PAYLOAD;
     static const int ROLLOFF_INTERVAL = IEEE1901_ROLLOFF_INTERVAL;
+    static const int FINE_SYNC_REFERENCE_OFFSET = SYNCP_SIZE * 11 / 2; // fine sync reference is the preamble around the SYNCP to SYNCM transition
+    static const int FINE_SYNC_REFERENCE_SIZE = SYNCP_SIZE * 4;
     static const int MIN_INTERFRAME_SPACE = IEEE1901_RIFS_DEFAULT * SAMPLE_RATE;
+    static const int TURBO_DEFAULT_ITERATIONS = 4;
 
     phy_service (bool debug = false);
     phy_service (tone_mask_t tone_mask, tone_mask_t broadcast_tone_mask, sync_tone_mask_t sync_tone_mask, channel_est_t channel_est, bool debug = false);
@@ -128,67 +205,110 @@ public:
 
     vector_complex create_ppdu(const unsigned char *mpdu_fc_bin, size_t mpdu_fc_len, const unsigned char *mpdu_payload_bin = NULL, size_t mpdu_payload_len = 0);
     vector_complex create_ppdu(vector_int &mpdu_fc_int, const vector_int &mpdu_payload_int = vector_int());
+    vector_complex create_ppdu(bitstream_t &mpdu_fc, const bitstream_t &mpdu_payload = bitstream_t());
+    size_t prepare_ppdu(const unsigned char *mpdu_fc_bin, size_t mpdu_fc_len, const unsigned char *mpdu_payload_bin = NULL, size_t mpdu_payload_len = 0);
+    size_t prepare_ppdu(bitstream_t &mpdu_fc, const bitstream_t &mpdu_payload = bitstream_t());
+    size_t generate_ppdu(complex *out, size_t n_samples); // next samples of the prepared PPDU, returns the number written
+    size_t prepare_ppdu(tx_state_t &ppdu, const unsigned char *mpdu_fc_bin, size_t mpdu_fc_len, const unsigned char *mpdu_payload_bin = NULL, size_t mpdu_payload_len = 0);
+    size_t prepare_ppdu(tx_state_t &ppdu, bitstream_t &mpdu_fc, const bitstream_t &mpdu_payload = bitstream_t());
+    size_t generate_ppdu(tx_state_t &ppdu, complex *out, size_t n_samples);
     void process_ppdu_preamble(vector_complex::const_iterator iter, vector_complex::const_iterator iter_end);
     bool process_ppdu_frame_control(vector_complex::const_iterator iter, vector_int &mpdu_fc_int);
     bool process_ppdu_frame_control(vector_complex::const_iterator iter, unsigned char* mpdu_fc_bin = NULL);
+    bool process_ppdu_frame_control(vector_complex::const_iterator iter, bitstream_t &mpdu_fc);
     void process_ppdu_payload(vector_complex::const_iterator iter, unsigned char *mpdu_payload_bin);
     vector_int process_ppdu_payload(vector_complex::const_iterator iter);
+    bool process_ppdu_payload_symbol(vector_complex::const_iterator iter); // one symbol with its guard interval, true after the last one
+    void get_mpdu_payload(unsigned char *mpdu_payload_bin);
+    int fine_sync(vector_complex::const_iterator iter, int n_offsets); // offset in [0, n_offsets) where preamble[FINE_SYNC_REFERENCE_OFFSET] fits best
     void process_noise(vector_complex::const_iterator iter, vector_complex::const_iterator iter_end);
+    void average_noise(vector_complex::const_iterator iter, float alpha); // averages the periodogram of the next NUMBER_OF_CARRIERS samples into the noise PSD
+    const tones_float_t &get_noise_psd();
+    void set_noise_psd(const tones_float_t &noise_psd);
     void post_process_ppdu();
+    void save_rx_frame_state(rx_frame_state_t &state); // the buffers are swapped, the next PPDU reuses the ones state held
+    void restore_rx_frame_state(rx_frame_state_t &state);
     tone_map_t calculate_tone_map(float P_t, tone_mask_t force_mask = tone_mask_t());
     void set_tone_map(tone_map_t tone_map);
     int get_mpdu_payload_size();
     int get_ppdu_payload_length();
+    static int max_ppdu_payload_length(); // longest payload a frame control can announce
     int max_blocks (tone_mode_t tone_mode);
+    void set_turbo_decoder(turbo_decoder_t decoder, int max_iterations = TURBO_DEFAULT_ITERATIONS);
+    void set_decoder_threads(unsigned int n_threads);
+    static void set_fftw_wisdom_file(const std::string &filename); // FFTW wisdom is loaded from and saved to this file, set before creating the first instance
     void debug(bool debug) {d_debug = debug; return;};
     stats_t stats;
 
 private:
-    tx_params_t get_tx_params (const vector_int &mpdu_fc_int);
-    void update_frame_control (vector_int &mpdu_fc_int, tx_params_t tx_params, size_t payload_size);
-    vector_complex create_payload_symbols(const vector_int &payload_bits, pb_size_t pb_size, tone_mode_t tone_mode);
-    vector_int encode_payload(const vector_int &payload_bits, pb_size_t pb_size, code_rate_t rate, tone_mode_t tone_mode);
-    vector_complex create_frame_control_symbol(const vector_int &bitstream);
-    vector_int encode_frame_control(const vector_int &frame_control_bits);
-    static void pack_bitvector(vector_int::const_iterator begin, vector_int::const_iterator end, unsigned char* array);
-    static vector_int unpack_into_bitvector (const unsigned char *data, size_t c);
-    static unsigned long crc24(const vector_int &bit_vector);
-    static vector_int scrambler(const vector_int& bitstream, int &state);
+    tx_params_t get_tx_params (const bitstream_t &mpdu_fc);
+    void update_frame_control (bitstream_t &mpdu_fc, tx_params_t tx_params, size_t payload_size);
+    void next_ppdu_segment(tx_state_t &ppdu);
+    bitstream_t encode_payload(const bitstream_t &payload_bits, pb_size_t pb_size, code_rate_t rate, tone_mode_t tone_mode);
+    vector_complex create_frame_control_symbol(const bitstream_t &bitstream);
+    bitstream_t encode_frame_control(const bitstream_t &frame_control_bits);
+    const bitstream_t &decode_ppdu_payload(vector_complex::const_iterator iter);
+    void reset_payload_decoder();
+    void slice_payload_symbol(vector_complex::const_iterator iter, complex *symbol);
+    void decode_payload_symbols();
+    void decode_payload_block(size_t block, size_t lane);
+    static unsigned long crc24(const bitstream_t &bitstream, size_t n_bits);
+    static bitstream_t scrambler(const bitstream_t& bitstream, int &state);
+    static void scrambler(const bitstream_t& bitstream, int &state, bitstream_t &out);
     static int scrambler_init(void);
+    static int scrambler_jump(int state, size_t n_bits);
     void init_turbo_codec();
-    vector_int tc_encoder(const vector_int &bitstream, pb_size_t pb_size, code_rate_t rate);
-    vector_int tc_decoder(const vector_float &received_info, const vector_float &received_parity, pb_size_t pb_size, code_rate_t rate);
-    static vector_int channel_interleaver(const vector_int& bitstream, const vector_int& parity, pb_size_t pb_size, code_rate_t rate);
-    vector_int robo_interleaver(const vector_int& bitstream, tone_mode_t tone_mode);
+    bitstream_t tc_encoder(const bitstream_t &bitstream, pb_size_t pb_size, code_rate_t rate);
+    void tc_decoder(const vector_float &received_info, const vector_float &received_parity, pb_size_t pb_size, code_rate_t rate, vector_int &decoded, size_t lane = 0);
+    bitstream_t channel_interleaver(const bitstream_t& bitstream, const bitstream_t& parity, pb_size_t pb_size, code_rate_t rate);
+    bitstream_t robo_interleaver(const bitstream_t& bitstream, tone_mode_t tone_mode);
     tone_info_t calc_robo_tone_info (tone_mode_t tone_mode);
-    tone_info_t get_tone_info (tone_mode_t tone_mode);
+    const tone_info_t &get_tone_info (tone_mode_t tone_mode);
     void calc_robo_parameters (tone_mode_t tone_mode, unsigned int n_raw, unsigned int &n_copies, unsigned int &bits_in_last_symbol, unsigned int &bits_in_segment, unsigned int &n_pad);
-    static vector_int copier(const vector_int& bitstream, int n_carriers, int offset, int start = 0);
-    vector_complex modulate(const vector_int& bits, const tone_info_t& tone_info);
-    static itpp::bvec to_bvec (const vector_int in);
+    static bitstream_t copier(const bitstream_t& bitstream, int n_carriers, int offset, int start = 0);
+    vector_complex modulate(const bitstream_t& bits, const tone_info_t& tone_info);
+    void modulate_symbol(const bitstream_t& bits, size_t &bit_pos, int &pn_step, const tone_info_t& tone_info, complex *symbol, bool fft_order = false);
     static itpp::ivec to_ivec (const vector_int in);
     static vector_int to_vector_int (const itpp::bvec in);
+    static const std::array<vector_int, 3> &turbo_interleaver_sequence();
     static std::array<vector_int, 3> calc_turbo_interleaver_sequence();
+    std::array<std::array<vector_int, 3>, 3> calc_robo_deinterleaver_sequence(const std::array<tone_info_t, 3> &robo_tone_info);
+    static vector_int calc_robo_cycle_shifts(unsigned int n_copies, unsigned int bits_in_last_symbol, unsigned int bits_in_segment);
+    static const channel_interleaver_tables_t &channel_interleaver_tables();
+    static void calc_channel_interleaver_sequence(std::array<std::array<vector_int, 3>, 3> &interleaver_sequence, std::array<std::array<vector_int, 3>, 3> &deinterleaver_sequence);
     static int pn_generator(int n_bits, int &pn_state);
     static int pn_generator_init(void);
-    static bool channel_interleaver_row(const vector_int& bitstream, vector_int::iterator &iter, int step_size, int& row_no, int& rows_done, int& nibble_no, bool wrap = false);
+    static bool channel_interleaver_row(const vector_int& bitstream, vector_int &out, int step_size, int& row_no, int& rows_done, int& nibble_no, bool wrap = false);
     vector_complex::iterator fft(vector_complex::const_iterator iter_begin, vector_complex::const_iterator iter_end, vector_complex::iterator iter_out);
     vector_complex::iterator ifft(vector_complex::const_iterator iter_begin, vector_complex::const_iterator iter_end, vector_complex::iterator iter_out);
+    void ifft_symbols(const complex *in, complex *out, size_t n_symbols); // in is in FFT order (carrier N/2 first)
+    void fft_symbols(const complex *in, complex *out, size_t n_symbols); // no unwrap, in should be multiplied by (-1)^n
+    void execute_symbols(const fftwf_plan &batch_plan, const fftwf_plan &plan, fftwf_complex *batch_input, fftwf_complex *batch_output, const complex *in, complex *out, size_t n_symbols);
+    std::shared_ptr<const sync_tables_t> shared_sync_tables();
+    std::shared_ptr<const robo_tables_t> shared_robo_tables();
     void calc_preamble(vector_complex &preamble, vector_complex &syncp_freq);
+    vector_complex calc_fine_sync_reference_freq(const vector_complex &preamble);
     vector_complex::iterator append_datastream(vector_complex::const_iterator symbol_iter_begin, vector_complex::const_iterator symbol_iter_end, vector_complex::iterator iter_out, size_t cp_length, float gain=1);
     static unsigned int count_non_masked_carriers(tone_mask_t::const_iterator begin, tone_mask_t::const_iterator end);
     static void update_tone_info_capacity(tone_info_t& tone_info);
-    bool get_rx_params (const vector_int &fc_bits, rx_params_t &rx_params);
-    static bool crc24_check(const vector_int &bit_vector);
-    vector_float::iterator demodulate_symbols (vector_complex::const_iterator iter, vector_complex::const_iterator iter_end, vector_float::iterator soft_bits_iter, const tone_map_t& tone_map, const channel_response_t &channel_response);
-    vector_float::iterator demodulate_soft_bits_helper(int n_bits, float r, float scale, float n0, vector_float::iterator iter);
-    vector_float::iterator demodulate_soft_bits(const complex &value, modulation_type_t modulation, float n0, vector_float::iterator iter);
+    void update_tone_info_plan(tone_info_t& tone_info);
+    static const rotated_maps_t &rotated_modulation_maps();
+    static rotated_maps_t calc_rotated_modulation_maps();
+    static const pn_table_t &pn_generator_table();
+    static pn_table_t calc_pn_generator_table();
+    bool get_rx_params (const bitstream_t &fc_bits, rx_params_t &rx_params);
+    static bool crc24_check(const bitstream_t &bitstream);
+    void calc_equalizer(const tone_map_t& tone_map, const channel_response_t &channel_response, equalizer_t &equalizer);
+    vector_float::iterator demodulate_symbols (vector_complex::const_iterator iter, vector_complex::const_iterator iter_end, vector_float::iterator soft_bits_iter, equalizer_t &equalizer);
+    template <modulation_type_t MODULATION, int N_BITS>
+    void demodulate_soft_bits(const complex *values, const float *llr_scales, const int *soft_bit_offsets, size_t n, float *soft_bits);
+    template <int N_BITS>
+    float *demodulate_pam_soft_bits(float r, float scale, float llr_scale, float *out);
     int qam_demodulate(int v, int l);
-    static vector_float combine_copies(vector_float& bitstream, int offset, int n_bits);
-    static vector_float channel_deinterleaver(const vector_float& bitstream, vector_float& parity_bitstream, pb_size_t pb_size, code_rate_t rate);
-    static bool channel_deinterleaver_row(vector_float::const_iterator& iter, vector_float& out, int step_size, int& row_no, int& rows_done, int& nibble_no, bool wrap = false);
-    vector_float robo_deinterleaver(const vector_float& bitstream, int n_raw, tone_mode_t tone_mode);
-    inline int calc_phy_block_size(pb_size_t pb_size);
+    static void combine_copies(const vector_float& bitstream, int offset, int n_bits, vector_float &out);
+    void channel_deinterleaver(vector_float::const_iterator iter, vector_float& info_bitstream, vector_float& parity_bitstream, pb_size_t pb_size, code_rate_t rate);
+    void robo_channel_deinterleaver(vector_float::const_iterator iter, vector_float& info_bitstream, vector_float& parity_bitstream, tone_mode_t tone_mode, pb_size_t pb_size, code_rate_t rate);
+    static int calc_phy_block_size(pb_size_t pb_size);
     int calc_fec_block_size(tone_mode_t tone_mode, code_rate_t rate, pb_size_t pb_size);
     static int calc_encoded_block_size(code_rate_t rate, pb_size_t pb_size);
     tone_info_t build_broadcast_tone_info(modulation_type_t modulation = MT_QPSK);
@@ -214,11 +334,49 @@ private:
     rx_params_t d_rx_params;
     vector_complex d_rx_payload_symbols_freq;
     vector_float d_rx_soft_bits;
-    vector_int d_rx_mpdu_payload;
+    bitstream_t d_rx_mpdu_payload;
+    equalizer_t d_rx_equalizer;
+    bool d_rx_equalizer_ready;
+    size_t d_rx_n_symbols_received;
+    size_t d_rx_n_symbols_demodulated;
+    size_t d_rx_n_blocks_decoded;
+    tx_state_t d_tx;
+    // Scratch buffers of the receiver, reused by every frame. They only grow, so they stop allocating once the largest frame was seen
+    typedef struct rx_lane_workspace_t {
+        vector_float received_info;
+        vector_float received_parity;
+        vector_int decoded_info;
+        bitstream_t descrambled;
+    } rx_lane_workspace_t;
+    typedef struct rx_workspace_t {
+        vector_complex syncp_avg, syncp_freq;
+        vector_complex fc_symbol, fc_symbol_freq;
+        vector_float fc_soft_bits, fc_decopied;
+        equalizer_t fc_equalizer;
+        bitstream_t mpdu_fc;
+        vector_complex symbols; // time domain payload symbols
+        vector_complex sync_block, sync_block_freq, sync_corr; // fine sync correlation
+        vector_complex noise_freq; // spectrum of a noise window
+        std::vector<rx_lane_workspace_t> lanes; // one per decoding lane, the frame control is decoded in lane 0
+    } rx_workspace_t;
+    rx_workspace_t d_rx_workspace;
+    // Plans shared by all the instances, each instance executes them on its own buffers
+    typedef struct fftw_plans_t {
+        fftwf_plan rev, fwd, rev_batch, fwd_batch, syncp_rev, syncp_fwd;
+    } fftw_plans_t;
+    static const fftw_plans_t &fftw_plans();
+    static fftw_plans_t create_fftw_plans();
     static std::mutex fftw_mtx;
+    static std::string fftw_wisdom_file; // guarded by fftw_mtx
     fftwf_complex *d_ifft_input, *d_ifft_output, *d_fft_input, *d_fft_output, *d_fft_syncp_input, *d_fft_syncp_output, *d_ifft_syncp_input, *d_ifft_syncp_output;
-    fftwf_plan d_fftw_rev_plan, d_fftw_fwd_plan, d_fftw_syncp_rev_plan, d_fftw_syncp_fwd_plan;
-    itpp::Punctured_Turbo_Codec d_turbo_codec;
+    static const int FFT_BATCH_SIZE = 8; // symbols per batched FFT call
+    fftwf_complex *d_ifft_batch_input, *d_ifft_batch_output, *d_fft_batch_input, *d_fft_batch_output;
+    std::vector<itpp::Punctured_Turbo_Codec> d_turbo_codecs; // one per decoding lane
+    std::vector<turbo_codec> d_native_turbo_codecs; // one per decoding lane
+    turbo_decoder_t d_turbo_decoder;
+    int d_turbo_iterations;
+    unsigned int d_decoder_threads;
+    std::shared_ptr<thread_pool> d_decoder_pool;
 };
 
 }; /* namespace light_plc */
@@ -45,11 +45,15 @@ int main(int argc, char * argv[]) {
     bool encode_only = false;
     if(cmdOptionExists(argv, argv+argc, "-help")) {
         std::cout << "Options:\n"
-        << "  -mode MODE          Can be SOF, SOUND, SACK, SOFFILE, RANDOM.\n"
+        << "  -mode MODE          Can be SOF, SOUND, SACK, SOFFILE, TURBO, SCRAMBLER, DEMAPPER, RANDOM.\n"
+        << "                      TURBO compares the IT++ and native turbo codecs, the decoders on a SOF\n"
+        << "                      at -snr and the 4 dB below it\n"
+        << "                      SCRAMBLER checks the scrambler jump against single LFSR steps\n"
+        << "                      DEMAPPER checks the soft bits against a search of the constellations\n"
         << "                      Default to RANDOM (100 random tests)\n"
-        << "  -robo-mode NUMBER   Set ROBO mode in SOF, SOUND or SOFFILE modes\n"
+        << "  -robo-mode NUMBER   Set ROBO mode in SOF, SOUND, SOFFILE or TURBO modes\n"
         << "                      Default to 3 (TM_NO_ROBO)\n"
-        << "  -nblocks NUMBER     Set number of blocks to encode in SOF or SOFFILE modes\n"
+        << "  -nblocks NUMBER     Set number of blocks to encode in SOF, SOFFILE or TURBO modes\n"
         << "                      Default = 1\n"
         << "  -snr NUMBER         Set noise according to SNR number in db\n"
         << "                      Default = 30db\n"
@@ -57,7 +61,8 @@ int main(int argc, char * argv[]) {
         << "  -in_filename NAME   Input file name is SOFFILE mode\n"
         << "  -out_filename NAME  Output file name is SOFFILE mode\n"
         << "  -d                  Print debug output\n"
-        << "  -seed NUMBER        Use seed number for random values\n" << std::endl;
+        << "  -seed NUMBER        Use seed number for random values\n"
+        << "  -wisdom NAME        Load and save FFTW wisdom in this file\n" << std::endl;
         return 0;
     }
 
@@ -73,6 +78,10 @@ int main(int argc, char * argv[]) {
     if (seed_str != NULL)
         seed = (light_plc::tone_mode_t)atoi(seed_str);
 
+    char* wisdom_filename = getCmdOption(argv, argv + argc, "-wisdom");
+    if (wisdom_filename != NULL)
+        light_plc::phy_service::set_fftw_wisdom_file(wisdom_filename);
+
     qa_phy_service tester(debug_, seed);
 
     char* tone_mode_str = getCmdOption(argv, argv + argc, "-robo-mode");
@@ -106,6 +115,15 @@ int main(int argc, char * argv[]) {
         tester.encode_to_file(tone_mode, 1, in_filename, out_filename);
     else if (std::string(mode_str) == "SACK")
         tester.test_sack();
+    else if (std::string(mode_str) == "TURBO") {
+        tester.test_turbo_encoder(10);
+        tester.test_sound(TM_STD_ROBO, snr, encode_only);
+        tester.test_turbo_decoder(tone_mode, nblocks, snr);
+    }
+    else if (std::string(mode_str) == "SCRAMBLER")
+        tester.test_scrambler_jump(100);
+    else if (std::string(mode_str) == "DEMAPPER")
+        tester.test_demapper(100);
 
 
     //tester.encode_to_file(RATE_1_2, TM_NO_ROBO, QAM1024, 1, "input.bin", "output.bin");
@@ -17,10 +17,13 @@
  */
  
 #include <time.h>
+#include <chrono>
 #include <iostream>
 #include <algorithm>
 #include <fstream>
+#include <limits>
 #include "qa_phy_service.h"
+#include "turbo_codec.h"
 
 using namespace light_plc;
 
@@ -42,6 +45,9 @@ int binary_random() { return ((rand() % 2) == 0); }
 int qa_phy_service::integer_random(int max) { return (rand() % (max+1)); }
 
 bool qa_phy_service::random_test(int number_of_tests, bool encode_only) {
+    if (!test_turbo_encoder(10) || !test_scrambler_jump(10) || !test_demapper(10))
+        return false;
+
     // First send sounding
     std::cout << "Test 1 (Sound)" << std::endl;
 
@@ -101,6 +107,16 @@ bool qa_phy_service::test_sof(tone_mode_t tone_mode, int number_of_blocks, float
     vector_int fc = create_sof_frame_control(tone_mode, pb_size);
     vector_complex datastream = d_phy.create_ppdu(fc, payload);
 
+    // Generating the same PPDU in small chunks should give the same datastream
+    bitstream_t fc_bits(fc);
+    vector_complex chunked_datastream(d_phy.prepare_ppdu(fc_bits, bitstream_t(payload)));
+    for (size_t n = 0; n < chunked_datastream.size(); n += 1000)
+        d_phy.generate_ppdu(chunked_datastream.data() + n, std::min(chunked_datastream.size() - n, (size_t)1000));
+    if (chunked_datastream != datastream) {
+        std::cout << "Failed!" << std::endl;
+        return false;
+    }
+
     vector_complex noise = add_noise(datastream.begin(), datastream.end(), SNRdb);
     d_phy.process_noise(noise.begin(), noise.end());
 
@@ -113,9 +129,33 @@ bool qa_phy_service::test_sof(tone_mode_t tone_mode, int number_of_blocks, float
             std::cout << "Failed!" << std::endl;
             return false;
         }
+        phy_service streaming_phy(d_phy);
+        phy_service lanes_phy(d_phy);
+        phy_service native_phy(d_phy);
+        phy_service scalar_phy(d_phy);
         vector_int return_payload = d_phy.process_ppdu_payload(iter += phy_service::FRAME_CONTROL_SIZE);
+
+        // Decode again symbol by symbol, the result should be the same
+        for (int n = 0; n < streaming_phy.get_ppdu_payload_length(); n += phy_service::PAYLOAD_SYMBOL_SIZE)
+            streaming_phy.process_ppdu_payload_symbol(iter + n);
+        std::vector<unsigned char> streaming_payload_bin(streaming_phy.get_mpdu_payload_size());
+        streaming_phy.get_mpdu_payload(streaming_payload_bin.data());
+        vector_int streaming_payload = bitstream_t(streaming_payload_bin.data(), streaming_payload_bin.size()).to_vector_int();
+
+        // Decode again with the blocks spread over three lanes, the result should be the same
+        lanes_phy.set_decoder_threads(3);
+        vector_int lanes_payload = lanes_phy.process_ppdu_payload(iter);
+
+        // Decode again with the native turbo decoder, and with its plain float version
+        native_phy.set_turbo_decoder(TD_NATIVE);
+        vector_int native_payload = native_phy.process_ppdu_payload(iter);
+        scalar_phy.set_turbo_decoder(TD_NATIVE);
+        use_scalar_turbo_decoder(scalar_phy);
+        vector_int scalar_payload = scalar_phy.process_ppdu_payload(iter);
+
         iter += d_phy.get_ppdu_payload_length();
-        if (std::equal(payload.begin(), payload.end(), return_payload.begin())) {
+        if (std::equal(payload.begin(), payload.end(), return_payload.begin()) && streaming_payload == return_payload && lanes_payload == return_payload
+            && native_payload == return_payload && scalar_payload == return_payload) {
             d_phy.post_process_ppdu();
             std::cout << "Bits: " << d_phy.stats.n_bits << std::endl;
             std::cout << "BER: " << d_phy.stats.ber << std::endl;
@@ -199,6 +239,210 @@ bool qa_phy_service::test_sound(tone_mode_t tone_mode, float SNRdb, bool encode_
     }
 }
 
+bool qa_phy_service::test_turbo_decoder(tone_mode_t tone_mode, int number_of_blocks, float SNRdb) {
+    if (tone_mode == TM_NO_ROBO) // make sure only one block ends in the last OFDM symbol when not in ROBO mode
+        while (((8332*number_of_blocks) % d_capacity) > 8332)
+            number_of_blocks--;
+
+    vector_int payload(520*8*number_of_blocks);
+    std::cout << "ROBO mode: " << tone_mode << std::endl;
+    std::cout << "number of blocks: " << number_of_blocks << std::endl;
+    std::generate(payload.begin(), payload.end(), binary_random);
+    pb_size_t pb_size;
+    (payload.size() > 136*8) ? pb_size = PB520 : pb_size = PB136;
+    vector_int fc = create_sof_frame_control(tone_mode, pb_size);
+    const vector_complex datastream = d_phy.create_ppdu(fc, payload);
+
+    // Decode the same noisy frame with each decoder, starting from the same receiver state, over a few
+    // SNRs up to SNRdb. The native decoder, in its SIMD and its plain float version, should not lose
+    // more blocks than the IT++ decoder
+    const char *decoder_names[] = {"IT++", "Native", "Native scalar"};
+    int block_errors[3] = {0, 0, 0};
+    for (float snr = SNRdb - 4; snr <= SNRdb; snr += 1) {
+        vector_complex received(datastream);
+        vector_complex noise = add_noise(received.begin(), received.end(), snr);
+        d_phy.process_noise(noise.begin(), noise.end());
+        for (int d = 0; d < 3; d++) {
+            phy_service phy(d_phy);
+            phy.set_turbo_decoder(d == 0 ? TD_ITPP : TD_NATIVE);
+            if (d == 2)
+                use_scalar_turbo_decoder(phy);
+            auto start = std::chrono::steady_clock::now();
+            vector_complex::const_iterator iter = received.begin();
+            phy.process_ppdu_preamble(iter, iter + phy_service::PREAMBLE_SIZE);
+            size_t errors = payload.size();
+            int frame_block_errors = number_of_blocks;
+            if (phy.process_ppdu_frame_control(iter += phy_service::PREAMBLE_SIZE)) {
+                vector_int return_payload = phy.process_ppdu_payload(iter += phy_service::FRAME_CONTROL_SIZE);
+                errors = 0;
+                frame_block_errors = 0;
+                for (int block = 0; block < number_of_blocks; block++) {
+                    size_t block_bit_errors = 0;
+                    for (size_t i = block * 520 * 8; i < (size_t)(block + 1) * 520 * 8; i++)
+                        block_bit_errors += (payload[i] != return_payload[i]);
+                    errors += block_bit_errors;
+                    frame_block_errors += (block_bit_errors > 0);
+                }
+            }
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            block_errors[d] += frame_block_errors;
+            std::cout << decoder_names[d] << " decoder: bit errors = " << errors << " (BER=" << (float)errors/payload.size() << ")"
+                << ", block errors = " << frame_block_errors << ", time = " << elapsed.count() * 1000 << "ms ("
+                << payload.size() / elapsed.count() / 1e6 << " Mbps)" << std::endl;
+        }
+    }
+
+    std::cout << "Block errors: IT++ = " << block_errors[0] << ", native = " << block_errors[1] << ", native scalar = " << block_errors[2] << std::endl;
+    if (block_errors[1] <= block_errors[0] && block_errors[2] <= block_errors[0]) {
+        std::cout << "Passed." << std::endl << std::endl;
+        return true;
+    } else {
+        std::cout << "Failed!" << std::endl;
+        return false;
+    }
+}
+
+bool qa_phy_service::test_turbo_encoder(int number_of_tests) {
+    // The native encoder should give the parity of itpp::Punctured_Turbo_Codec: the punctured parity bits,
+    // then the 9 tail bits and 3 zero bits of padding
+    itpp::ivec gen(2);
+    gen(0) = 013; gen(1) = 015;
+    itpp::bmat puncture_matrix = "1;1;1";
+    itpp::Punctured_Turbo_Codec itpp_codec;
+    itpp_codec.set_parameters(gen, gen, 4, itpp::ivec(), puncture_matrix, 1, "LOGMAX", 1.0, true, itpp::LLR_calc_unit());
+    puncture_matrix = "1 1;1 0;0 1";
+    itpp_codec.set_puncture_matrix(puncture_matrix);
+
+    const pb_size_t pb_sizes[] = {PB16, PB136, PB520};
+    for (int p = 0; p < 3; p++) {
+        pb_size_t pb_size = pb_sizes[p];
+        int n_bits = phy_service::calc_phy_block_size(pb_size);
+        const vector_int &interleaver = phy_service::turbo_interleaver_sequence()[pb_size];
+        itpp::ivec interleaver_ivec(interleaver.size());
+        for (size_t i = 0; i < interleaver.size(); i++)
+            interleaver_ivec(i) = interleaver[i];
+        itpp_codec.set_interleaver(interleaver_ivec);
+
+        for (int t = 0; t < number_of_tests; t++) {
+            vector_int info(n_bits);
+            std::generate(info.begin(), info.end(), binary_random);
+            itpp::bvec info_bvec(n_bits), encoded;
+            for (int i = 0; i < n_bits; i++)
+                info_bvec(i) = info[i];
+            itpp_codec.encode(info_bvec, encoded);
+
+            vector_int expected(n_bits + turbo_codec::N_PARITY_PAD_BITS, 0);
+            int i = 0;
+            for (; i < n_bits; i++)
+                expected[i] = encoded(i*2+1); // first bit is systematic, second is parity
+            for (int j = i*2; j < encoded.size(); j++)
+                expected[i++] = encoded(j);
+
+            vector_int parity = d_phy.tc_encoder(bitstream_t(info), pb_size, RATE_1_2).to_vector_int();
+            if (parity != expected) {
+                std::cout << "Turbo encoder, block size " << n_bits / 8 << ": Failed!" << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << "Turbo encoder: Passed." << std::endl << std::endl;
+    return true;
+}
+
+bool qa_phy_service::test_scrambler_jump(int number_of_tests) {
+    // Jumping the scrambler ahead should give the state of n single LFSR steps, and of scrambling n bits.
+    // The offsets are taken around the word and the PHY block boundaries, and at random
+    vector_int offsets = {0, 1, 2, 9, 10, 1023, 1024};
+    const int boundaries[] = {bitstream_t::WORD_BITS, phy_service::calc_phy_block_size(PB16),
+                              phy_service::calc_phy_block_size(PB136), phy_service::calc_phy_block_size(PB520)};
+    for (int boundary : boundaries)
+        for (int multiple = 1; multiple <= 3; multiple++)
+            for (int delta = -1; delta <= 1; delta++)
+                offsets.push_back(multiple * boundary + delta);
+    for (int t = 0; t < number_of_tests; t++)
+        offsets.push_back(integer_random(4 * phy_service::calc_phy_block_size(PB520)));
+
+    for (int t = 0; t < number_of_tests; t++) {
+        int state = t == 0 ? phy_service::scrambler_init() : 1 + integer_random(0x3FE);
+        for (int n : offsets) {
+            int expected = state;
+            for (int i = 0; i < n; i++) {
+                int feedback = ((expected >> 9) ^ (expected >> 2)) & 1;
+                expected = ((expected << 1) & 0x3FF) | feedback;
+            }
+            int scrambled = state;
+            phy_service::scrambler(bitstream_t(n), scrambled);
+            int jumped = phy_service::scrambler_jump(state, n);
+            if (jumped != expected || scrambled != expected) {
+                std::cout << "Scrambler jump, state " << state << " offset " << n << ": Failed!" << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << "Scrambler jump: Passed." << std::endl << std::endl;
+    return true;
+}
+
+bool qa_phy_service::test_demapper(int number_of_tests) {
+    // Every soft bit should be the max-log LLR found by searching the whole constellation: the distance
+    // to the closest point with the bit set against the closest point with the bit cleared. Groups of
+    // 0 to 13 carriers per modulation exercise both the batches of carriers and the ones left over
+    for (int t = 0; t < number_of_tests; t++) {
+        phy_service::equalizer_t equalizer;
+        vector_int modulations;
+        equalizer.n_bits = 0;
+        for (int m = MT_NULLED; m <= MT_QAM4096; m++) {
+            equalizer.group_begin[m] = modulations.size();
+            int n = m == MT_NULLED ? 0 : integer_random(13);
+            for (int k = 0; k < n; k++) {
+                modulations.push_back(m);
+                equalizer.soft_bit_offsets.push_back(equalizer.n_bits);
+                equalizer.n_bits += phy_service::MODULATION_MAP[m].n_bits;
+            }
+        }
+        equalizer.group_begin[MT_QAM4096 + 1] = modulations.size();
+        size_t n_carriers = modulations.size();
+        equalizer.carriers.resize(n_carriers);
+        equalizer.coefficients.assign(n_carriers, complex(1, 0));
+        equalizer.llr_scales.resize(n_carriers);
+        equalizer.values.resize(n_carriers);
+
+        // Received values up to twice the largest point, so the clipping to the outer points is tested too
+        vector_complex symbol(phy_service::NUMBER_OF_CARRIERS);
+        for (size_t k = 0; k < n_carriers; k++) {
+            equalizer.carriers[k] = k;
+            equalizer.llr_scales[k] = 0.1 + 100.0 * rand() / RAND_MAX;
+            symbol[k] = complex(3.0 * rand() / RAND_MAX - 1.5, 3.0 * rand() / RAND_MAX - 1.5);
+        }
+        vector_float soft_bits(equalizer.n_bits);
+        d_phy.demodulate_symbols(symbol.begin(), symbol.end(), soft_bits.begin(), equalizer);
+
+        for (size_t k = 0; k < n_carriers; k++) {
+            const phy_service::modulation_map_t &modulation_map = phy_service::MODULATION_MAP[modulations[k]];
+            for (unsigned int b = 0; b < modulation_map.n_bits; b++) {
+                float d[2] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+                for (int p = 0; p < (1 << modulation_map.n_bits); p++) {
+                    float distance = std::norm(symbol[k] - modulation_map.map[p] * modulation_map.scale);
+                    d[(p >> b) & 1] = std::min(d[(p >> b) & 1], distance);
+                }
+                float expected = (d[1] - d[0]) * equalizer.llr_scales[k];
+                float soft_bit = soft_bits[equalizer.soft_bit_offsets[k] + b];
+                if (std::abs(soft_bit - expected) > 1e-3 * equalizer.llr_scales[k] + 1e-4 * std::abs(expected)) {
+                    std::cout << "Demapper, modulation " << modulations[k] << " bit " << b << ": Failed! (" << soft_bit << " instead of " << expected << ")" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    std::cout << "Demapper: Passed." << std::endl << std::endl;
+    return true;
+}
+
+void qa_phy_service::use_scalar_turbo_decoder(phy_service &phy) {
+    for (turbo_codec &codec : phy.d_native_turbo_codecs)
+        codec.set_scalar(true);
+}
+
 void qa_phy_service::calc_capacity() {
     d_capacity = 0;
     for (auto it = d_tone_map.begin(); it != d_tone_map.end(); it++)
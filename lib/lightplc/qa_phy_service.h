@@ -28,6 +28,10 @@ public:
     bool test_sof(tone_mode_t tone_mode, int number_of_blocks, float SNRdb = 30, bool encode_only = false);
 		bool test_sack(float SNRdb = 30, bool encode_only = false);
 		bool test_sound(tone_mode_t tone_mode, float SNRdb = 30, bool encode_only = false);
+		bool test_turbo_decoder(tone_mode_t tone_mode, int number_of_blocks, float SNRdb = 30);
+		bool test_turbo_encoder(int number_of_tests);
+		bool test_scrambler_jump(int number_of_tests);
+		bool test_demapper(int number_of_tests);
 		vector_complex add_noise(vector_complex::iterator iter_begin, vector_complex::iterator iter_end, float SNRdb);
     bool encode_to_file(tone_mode_t tone_mode, int number_of_blocks, std::string input_filename, std::string output_filename);
     void calc_capacity();
@@ -37,6 +41,7 @@ private:
     vector_int create_sound_frame_control (tone_mode_t tone_mode);
     vector_int create_sack_frame_control (const vector_int &sackd);
     int integer_random(int max);
+    void use_scalar_turbo_decoder(phy_service &phy);
     phy_service d_phy;
     bool d_debug;
     tone_map_t d_tone_map;
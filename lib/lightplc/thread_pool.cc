@@ -0,0 +1,82 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace light_plc {
+
+thread_pool::thread_pool(unsigned int n_workers) : d_stop(false) {
+    for (unsigned int i = 0; i < n_workers; i++)
+        d_workers.push_back(std::thread(&thread_pool::worker, this));
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock(d_mutex);
+        d_stop = true;
+    }
+    d_work_cond.notify_all();
+    for (size_t i = 0; i < d_workers.size(); i++)
+        d_workers[i].join();
+}
+
+void thread_pool::parallel_for(size_t n, const std::function<void(size_t)> &f) {
+    if (n == 0)
+        return;
+    job_t job = {&f, n, 0, 0};
+    std::unique_lock<std::mutex> lock(d_mutex);
+    if (n > 1 && d_workers.size()) {
+        d_jobs.push_back(&job);
+        d_work_cond.notify_all();
+    }
+    while (job.next < job.n)
+        run_next(job, lock);
+    d_done_cond.wait(lock, [&job] { return job.done == job.n; });
+}
+
+void thread_pool::run_next(job_t &job, std::unique_lock<std::mutex> &lock) {
+    size_t i = job.next++;
+    if (job.next == job.n) { // no more iterations to hand out
+        std::deque<job_t*>::iterator iter = std::find(d_jobs.begin(), d_jobs.end(), &job);
+        if (iter != d_jobs.end())
+            d_jobs.erase(iter);
+    }
+    lock.unlock();
+    (*job.f)(i);
+    lock.lock();
+    if (++job.done == job.n)
+        d_done_cond.notify_all();
+}
+
+void thread_pool::worker() {
+    std::unique_lock<std::mutex> lock(d_mutex);
+    while (true) {
+        d_work_cond.wait(lock, [this] { return d_stop || !d_jobs.empty(); });
+        if (d_stop)
+            return;
+        run_next(*d_jobs.front(), lock);
+    }
+}
+
+thread_pool &thread_pool::shared() {
+    static thread_pool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+} /* namespace light_plc */
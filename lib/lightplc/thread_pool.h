@@ -0,0 +1,71 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIGHT_PLC_THREAD_POOL
+#define _LIGHT_PLC_THREAD_POOL
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace light_plc {
+
+/*
+ * Fixed set of worker threads running parallel loops. The calling thread takes iterations of its own
+ * loop too, so a pool of n workers runs a loop on up to n+1 threads. Loops may be started from several
+ * threads at once.
+ */
+class thread_pool
+{
+public:
+    explicit thread_pool(unsigned int n_workers);
+    ~thread_pool();
+
+    // Calls f(0), ..., f(n-1) and returns when all the calls are done
+    void parallel_for(size_t n, const std::function<void(size_t)> &f);
+    unsigned int size() const { return d_workers.size(); }
+
+    // Pool shared by the process, with a worker for every hardware thread beside the caller
+    static thread_pool &shared();
+
+private:
+    typedef struct job_t {
+        const std::function<void(size_t)> *f;
+        size_t n;
+        size_t next; // next iteration to start
+        size_t done; // iterations finished
+    } job_t;
+
+    void worker();
+    void run_next(job_t &job, std::unique_lock<std::mutex> &lock);
+
+    std::vector<std::thread> d_workers;
+    std::deque<job_t*> d_jobs; // jobs with iterations left to start
+    std::mutex d_mutex; // guards d_jobs, the jobs and d_stop
+    std::condition_variable d_work_cond;
+    std::condition_variable d_done_cond;
+    bool d_stop;
+};
+
+} /* namespace light_plc */
+
+#endif /* _LIGHT_PLC_THREAD_POOL */
@@ -0,0 +1,335 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "turbo_codec.h"
+#include <algorithm>
+#include <cstring>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace light_plc {
+
+static const int RSC_FEEDBACK_POLY = 013;
+static const int RSC_FEEDFORWARD_POLY = 015;
+
+/*
+ * Path metrics of the 8 trellis states. With AVX2 they fit a single register, with SSE2 two registers
+ * (states 0-3 and 4-7), otherwise plain floats. The trellis only needs the fixed state permutations below:
+ * the predecessors of state s are s>>1 and s>>1|4, the successors of state s are s<<1 and s<<1|1 (mod 8).
+ * The plain float version is always built, so it can be checked against the SIMD one.
+ */
+struct scalar_metrics {
+    struct metric8_t { float v[8]; };
+    struct mask8_t { int v[8]; };
+    static metric8_t load(const float *p) { metric8_t r; std::copy(p, p + 8, r.v); return r; }
+    static void store(float *p, metric8_t a) { std::copy(a.v, a.v + 8, p); }
+    static mask8_t load_mask(const int *p) { mask8_t r; std::copy(p, p + 8, r.v); return r; }
+    static metric8_t add(metric8_t a, metric8_t b) { for (int s = 0; s < 8; s++) a.v[s] += b.v[s]; return a; }
+    static metric8_t max(metric8_t a, metric8_t b) { for (int s = 0; s < 8; s++) a.v[s] = std::max(a.v[s], b.v[s]); return a; }
+    static metric8_t madd(metric8_t a, float x, metric8_t b) { for (int s = 0; s < 8; s++) a.v[s] += x * b.v[s]; return a; }
+    static metric8_t sub(metric8_t a, float x) { for (int s = 0; s < 8; s++) a.v[s] -= x; return a; }
+    static float first(metric8_t a) { return a.v[0]; }
+    static metric8_t dup_low(metric8_t a) { metric8_t r; for (int s = 0; s < 8; s++) r.v[s] = a.v[s >> 1]; return r; }
+    static metric8_t dup_high(metric8_t a) { metric8_t r; for (int s = 0; s < 8; s++) r.v[s] = a.v[4 + (s >> 1)]; return r; }
+    static metric8_t even(metric8_t a) { metric8_t r; for (int s = 0; s < 8; s++) r.v[s] = a.v[(s << 1) & 7]; return r; }
+    static metric8_t odd(metric8_t a) { metric8_t r; for (int s = 0; s < 8; s++) r.v[s] = a.v[((s << 1) | 1) & 7]; return r; }
+    static metric8_t select(mask8_t m, metric8_t a, metric8_t b) { for (int s = 0; s < 8; s++) if (!m.v[s]) a.v[s] = b.v[s]; return a; }
+    static float hmax(metric8_t a) { return *std::max_element(a.v, a.v + 8); }
+};
+
+#if defined(__AVX2__)
+struct simd_metrics {
+    struct metric8_t { __m256 v; };
+    typedef __m256 mask8_t;
+    static metric8_t load(const float *p) { return {_mm256_loadu_ps(p)}; }
+    static void store(float *p, metric8_t a) { _mm256_storeu_ps(p, a.v); }
+    static mask8_t load_mask(const int *p) { return _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)p)); }
+    static metric8_t add(metric8_t a, metric8_t b) { return {_mm256_add_ps(a.v, b.v)}; }
+    static metric8_t max(metric8_t a, metric8_t b) { return {_mm256_max_ps(a.v, b.v)}; }
+    static metric8_t madd(metric8_t a, float s, metric8_t b) { return {_mm256_add_ps(a.v, _mm256_mul_ps(_mm256_set1_ps(s), b.v))}; }
+    static metric8_t sub(metric8_t a, float s) { return {_mm256_sub_ps(a.v, _mm256_set1_ps(s))}; }
+    static float first(metric8_t a) { return _mm_cvtss_f32(_mm256_castps256_ps128(a.v)); }
+    static metric8_t dup_low(metric8_t a) { return {_mm256_permutevar8x32_ps(a.v, _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3))}; }
+    static metric8_t dup_high(metric8_t a) { return {_mm256_permutevar8x32_ps(a.v, _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7))}; }
+    static metric8_t even(metric8_t a) { return {_mm256_permutevar8x32_ps(a.v, _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6))}; }
+    static metric8_t odd(metric8_t a) { return {_mm256_permutevar8x32_ps(a.v, _mm256_setr_epi32(1, 3, 5, 7, 1, 3, 5, 7))}; }
+    static metric8_t select(mask8_t m, metric8_t a, metric8_t b) { return {_mm256_blendv_ps(b.v, a.v, m)}; }
+    static float hmax(metric8_t a) {
+        __m128 r = _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+        r = _mm_max_ps(r, _mm_movehl_ps(r, r));
+        r = _mm_max_ss(r, _mm_shuffle_ps(r, r, 1));
+        return _mm_cvtss_f32(r);
+    }
+};
+#elif defined(__SSE2__)
+struct simd_metrics {
+    struct metric8_t { __m128 lo, hi; };
+    struct mask8_t { __m128 lo, hi; };
+    static metric8_t load(const float *p) { return {_mm_loadu_ps(p), _mm_loadu_ps(p + 4)}; }
+    static void store(float *p, metric8_t a) { _mm_storeu_ps(p, a.lo); _mm_storeu_ps(p + 4, a.hi); }
+    static mask8_t load_mask(const int *p) { return {_mm_castsi128_ps(_mm_loadu_si128((const __m128i *)p)), _mm_castsi128_ps(_mm_loadu_si128((const __m128i *)(p + 4)))}; }
+    static metric8_t add(metric8_t a, metric8_t b) { return {_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)}; }
+    static metric8_t max(metric8_t a, metric8_t b) { return {_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)}; }
+    static metric8_t madd(metric8_t a, float s, metric8_t b) {
+        __m128 v = _mm_set1_ps(s);
+        return {_mm_add_ps(a.lo, _mm_mul_ps(v, b.lo)), _mm_add_ps(a.hi, _mm_mul_ps(v, b.hi))};
+    }
+    static metric8_t sub(metric8_t a, float s) { __m128 v = _mm_set1_ps(s); return {_mm_sub_ps(a.lo, v), _mm_sub_ps(a.hi, v)}; }
+    static float first(metric8_t a) { return _mm_cvtss_f32(a.lo); }
+    static metric8_t dup_low(metric8_t a) { return {_mm_unpacklo_ps(a.lo, a.lo), _mm_unpackhi_ps(a.lo, a.lo)}; }
+    static metric8_t dup_high(metric8_t a) { return {_mm_unpacklo_ps(a.hi, a.hi), _mm_unpackhi_ps(a.hi, a.hi)}; }
+    static metric8_t even(metric8_t a) { __m128 v = _mm_shuffle_ps(a.lo, a.hi, _MM_SHUFFLE(2, 0, 2, 0)); return {v, v}; }
+    static metric8_t odd(metric8_t a) { __m128 v = _mm_shuffle_ps(a.lo, a.hi, _MM_SHUFFLE(3, 1, 3, 1)); return {v, v}; }
+    static metric8_t select(mask8_t m, metric8_t a, metric8_t b) {
+        return {_mm_or_ps(_mm_and_ps(m.lo, a.lo), _mm_andnot_ps(m.lo, b.lo)), _mm_or_ps(_mm_and_ps(m.hi, a.hi), _mm_andnot_ps(m.hi, b.hi))};
+    }
+    static float hmax(metric8_t a) {
+        __m128 r = _mm_max_ps(a.lo, a.hi);
+        r = _mm_max_ps(r, _mm_movehl_ps(r, r));
+        r = _mm_max_ss(r, _mm_shuffle_ps(r, r, 1));
+        return _mm_cvtss_f32(r);
+    }
+};
+#else
+typedef scalar_metrics simd_metrics;
+#endif
+
+static const float METRIC_MIN = -1e9f; // unreachable state
+
+static int reverse_bits(int value, int width) {
+    int r = 0;
+    for (int i = 0; i < width; i++, value >>= 1)
+        r = (r << 1) | (value & 1);
+    return r;
+}
+
+static int parity_of(int value) {
+    int p = 0;
+    for (; value; value >>= 1)
+        p ^= value & 1;
+    return p;
+}
+
+turbo_codec::rsc_table_t turbo_codec::calc_rsc_table() {
+    // The state holds the last MEMORY register bits with the newest bit as LSB (same as IT++)
+    static const int feedback = reverse_bits(RSC_FEEDBACK_POLY, MEMORY + 1);
+    static const int feedforward = reverse_bits(RSC_FEEDFORWARD_POLY, MEMORY + 1);
+    rsc_table_t table;
+    for (int s = 0; s < N_STATES; s++) {
+        // Walk 8 input bits (LSB first) from state s
+        for (int byte = 0; byte < 256; byte++) {
+            int state = s;
+            int parity = 0;
+            for (int j = 0; j < 8; j++) {
+                int in = parity_of(feedback & (state << 1)) ^ ((byte >> j) & 1);
+                parity |= parity_of(((state << 1) | in) & feedforward) << j;
+                state = ((state << 1) | in) & (N_STATES - 1);
+            }
+            table.next_state[s][byte] = state;
+            table.parity[s][byte] = parity;
+        }
+        // Termination: the input bit that cancels the feedback drives a zero into the register
+        table.tail_bit[s] = parity_of(feedback & (s << 1));
+        table.tail_parity[s] = parity_of((s << 1) & feedforward);
+    }
+    for (int s = 0; s < N_STATES; s++) {
+        for (int x = 0; x < 2; x++) {
+            int from = (s >> 1) | (x << (MEMORY - 1));
+            int reg = (from << 1) | (s & 1);
+            table.alpha_sys_sign[x][s] = 1 - 2 * (parity_of(feedback & (from << 1)) ^ (s & 1));
+            table.alpha_parity_sign[x][s] = 1 - 2 * parity_of(reg & feedforward);
+        }
+        for (int i = 0; i < 2; i++) {
+            int reg = (s << 1) | i;
+            table.beta_sys_sign[i][s] = 1 - 2 * (parity_of(feedback & (s << 1)) ^ i);
+            table.beta_parity_sign[i][s] = 1 - 2 * parity_of(reg & feedforward);
+        }
+        table.feedback_mask[s] = -parity_of(feedback & (s << 1));
+    }
+    return table;
+}
+
+const turbo_codec::rsc_table_t &turbo_codec::rsc_table() {
+    static const rsc_table_t table = calc_rsc_table();
+    return table;
+}
+
+unsigned char turbo_codec::rsc_encode(const unsigned char *bytes, size_t n_bytes, unsigned char *parity) {
+    const rsc_table_t &table = rsc_table();
+    unsigned char state = 0;
+    for (size_t i = 0; i < n_bytes; i++) {
+        parity[i] = table.parity[state][bytes[i]];
+        state = table.next_state[state][bytes[i]];
+    }
+    return state;
+}
+
+void turbo_codec::encode(const unsigned char *info, size_t n_bits, const vector_int &interleaver, unsigned char *parity) {
+    assert(n_bits % 8 == 0 && interleaver.size() == n_bits);
+    const rsc_table_t &table = rsc_table();
+    size_t n_bytes = n_bits / 8;
+
+    // Interleave the info bits for the second encoder
+    std::vector<unsigned char> interleaved(n_bytes, 0);
+    for (size_t i = 0; i < n_bits; i++)
+        set_bit(interleaved.data(), i, get_bit(info, interleaver[i]));
+
+    std::vector<unsigned char> parity1(n_bytes), parity2(n_bytes);
+    int state1 = rsc_encode(info, n_bytes, parity1.data());
+    int state2 = rsc_encode(interleaved.data(), n_bytes, parity2.data());
+
+    // Puncturing: even bits from the first encoder, odd bits from the second one
+    for (size_t i = 0; i < n_bytes; i++)
+        parity[i] = (parity1[i] & 0x55) | (parity2[i] & 0xAA);
+
+    // Tail bits continue the puncturing pattern phase of the (even length) data part:
+    // [x1 p1 x1 x1 p1] of the first encoder, then [x2 x2 p2 x2] of the second encoder
+    int tail[N_TAIL_BITS];
+    int *tail_iter = tail;
+    for (int k = 0; k < MEMORY; k++) {
+        *tail_iter++ = table.tail_bit[state1];
+        if (k % 2 == 0)
+            *tail_iter++ = table.tail_parity[state1];
+        state1 = (state1 << 1) & (N_STATES - 1);
+    }
+    for (int k = 0; k < MEMORY; k++) {
+        *tail_iter++ = table.tail_bit[state2];
+        if (k % 2 == 1)
+            *tail_iter++ = table.tail_parity[state2];
+        state2 = (state2 << 1) & (N_STATES - 1);
+    }
+
+    std::memset(parity + n_bytes, 0, (N_PARITY_PAD_BITS + 7) / 8);
+    for (int k = 0; k < N_TAIL_BITS; k++)
+        set_bit(parity, n_bits + k, tail[k]);
+}
+
+template <class M>
+void turbo_codec::siso_decode(const float *sys, const float *parity, const float *apriori, const float *tail_sys, const float *tail_parity, size_t n, float *extrinsic) {
+    static_assert(N_STATES == 8, "The path metrics are vectorized over 8 states");
+    typedef typename M::metric8_t metric8_t;
+    typedef typename M::mask8_t mask8_t;
+    const rsc_table_t &table = rsc_table();
+    const metric8_t alpha_sys0 = M::load(table.alpha_sys_sign[0]), alpha_sys1 = M::load(table.alpha_sys_sign[1]);
+    const metric8_t alpha_par0 = M::load(table.alpha_parity_sign[0]), alpha_par1 = M::load(table.alpha_parity_sign[1]);
+    const metric8_t beta_sys0 = M::load(table.beta_sys_sign[0]), beta_sys1 = M::load(table.beta_sys_sign[1]);
+    const metric8_t beta_par0 = M::load(table.beta_parity_sign[0]), beta_par1 = M::load(table.beta_parity_sign[1]);
+    const mask8_t feedback = M::load_mask(table.feedback_mask);
+
+    // Forward recursion, the encoder starts at state 0. Every 8 steps the metrics are renormalized
+    // to state 0, which is always reachable
+    d_alpha.resize((n + 1) * N_STATES);
+    float *alpha_iter = d_alpha.data();
+    std::fill(alpha_iter, alpha_iter + N_STATES, METRIC_MIN);
+    alpha_iter[0] = 0;
+    metric8_t alpha = M::load(alpha_iter);
+    for (size_t k = 0; k < n; k++) {
+        float a = (sys[k] + apriori[k]) / 2, b = parity[k] / 2;
+        metric8_t m0 = M::madd(M::madd(M::dup_low(alpha), a, alpha_sys0), b, alpha_par0);
+        metric8_t m1 = M::madd(M::madd(M::dup_high(alpha), a, alpha_sys1), b, alpha_par1);
+        alpha = M::max(m0, m1);
+        if (k % 8 == 7)
+            alpha = M::sub(alpha, M::first(alpha));
+        alpha_iter += N_STATES;
+        M::store(alpha_iter, alpha);
+    }
+
+    // Backward recursion over the tail, the encoder ends at state 0 and the input is forced
+    float beta_tail[N_STATES], beta_prev[N_STATES];
+    std::fill(beta_tail, beta_tail + N_STATES, METRIC_MIN);
+    beta_tail[0] = 0;
+    for (int k = MEMORY - 1; k >= 0; k--) {
+        std::copy(beta_tail, beta_tail + N_STATES, beta_prev);
+        for (int s = 0; s < N_STATES; s++)
+            beta_tail[s] = beta_prev[(s << 1) & (N_STATES - 1)]
+                + (1 - 2 * table.tail_bit[s]) * tail_sys[k] / 2 + (1 - 2 * table.tail_parity[s]) * tail_parity[k] / 2;
+    }
+
+    // Backward recursion over the data (renormalized as above), combined with the forward metrics
+    // into the extrinsic LLRs
+    metric8_t beta = M::load(beta_tail);
+    for (size_t k = n; k-- > 0; ) {
+        float a = (sys[k] + apriori[k]) / 2, b = parity[k] / 2;
+        metric8_t next0 = M::madd(M::even(beta), b, beta_par0);
+        metric8_t next1 = M::madd(M::odd(beta), b, beta_par1);
+        alpha = M::load(d_alpha.data() + k * N_STATES);
+        metric8_t m0 = M::add(alpha, next0), m1 = M::add(alpha, next1);
+        extrinsic[k] = M::hmax(M::select(feedback, m1, m0)) - M::hmax(M::select(feedback, m0, m1));
+        beta = M::max(M::madd(next0, a, beta_sys0), M::madd(next1, a, beta_sys1));
+        if (k % 8 == 0)
+            beta = M::sub(beta, M::first(beta));
+    }
+}
+
+int turbo_codec::decode(const float *info, const float *parity, size_t n_bits, const vector_int &interleaver, int max_iterations, int *decoded) {
+    assert(interleaver.size() == n_bits && max_iterations > 0);
+    const size_t n = n_bits;
+    d_sys2.resize(n);
+    d_parity1.assign(n, 0);
+    d_parity2.assign(n, 0);
+    d_apriori1.assign(n, 0);
+    d_apriori2.resize(n);
+    d_extrinsic1.resize(n);
+    d_extrinsic2.resize(n);
+    d_hard.assign(n, -1);
+
+    // Undo the puncturing: even parity bits belong to the first encoder, odd ones to the second
+    for (size_t i = 0; i < n; i++) {
+        d_sys2[i] = info[interleaver[i]];
+        if (i % 2 == 0)
+            d_parity1[i] = parity[i];
+        else
+            d_parity2[i] = parity[i];
+    }
+    // Tail layout is [x1 p1 x1 x1 p1 x2 x2 p2 x2], see encode()
+    const float *tail = parity + n;
+    const float tail_sys1[MEMORY] = {tail[0], tail[2], tail[3]};
+    const float tail_parity1[MEMORY] = {tail[1], 0, tail[4]};
+    const float tail_sys2[MEMORY] = {tail[5], tail[6], tail[8]};
+    const float tail_parity2[MEMORY] = {0, tail[7], 0};
+
+    int iteration = 0;
+    bool done = false;
+    void (turbo_codec::*siso)(const float *, const float *, const float *, const float *, const float *, size_t, float *) =
+        d_scalar ? &turbo_codec::siso_decode<scalar_metrics> : &turbo_codec::siso_decode<simd_metrics>;
+    while (!done && iteration < max_iterations) {
+        (this->*siso)(info, d_parity1.data(), d_apriori1.data(), tail_sys1, tail_parity1, n, d_extrinsic1.data());
+        for (size_t i = 0; i < n; i++)
+            d_apriori2[i] = d_extrinsic1[interleaver[i]];
+        (this->*siso)(d_sys2.data(), d_parity2.data(), d_apriori2.data(), tail_sys2, tail_parity2, n, d_extrinsic2.data());
+        iteration++;
+
+        done = true;
+        for (size_t i = 0; i < n; i++) {
+            int j = interleaver[i];
+            d_apriori1[j] = d_extrinsic2[i];
+            int bit = d_sys2[i] + d_apriori2[i] + d_extrinsic2[i] < 0;
+            if (bit != d_hard[j]) {
+                d_hard[j] = bit;
+                done = false;
+            }
+        }
+    }
+    std::copy(d_hard.begin(), d_hard.end(), decoded);
+    return iteration;
+}
+
+} /* namespace light_plc */
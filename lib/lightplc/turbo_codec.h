@@ -0,0 +1,92 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LIGHT_PLC_TURBO_CODEC
+#define _LIGHT_PLC_TURBO_CODEC
+
+#include <cstddef>
+#include <vector>
+#include "defs.h"
+
+namespace light_plc {
+
+/*
+ * Turbo codec built from two 8-state RSC encoders with generators 013 (feedback)
+ * and 015 (feedforward), punctured to rate 1/2. The output matches itpp::Punctured_Turbo_Codec
+ * with puncture matrix "1 1;1 0;0 1": parity[i] comes from the first encoder for even i and from
+ * the second one for odd i, followed by the 9 tail bits and 3 zero bits of padding.
+ */
+class turbo_codec
+{
+public:
+    static const int MEMORY = 3;
+    static const int N_STATES = 1 << MEMORY;
+    static const int N_TAIL_BITS = 9;
+    static const int N_PARITY_PAD_BITS = 12; // tail bits rounded up to the channel interleaver nibble
+
+    turbo_codec() : d_scalar(false) {}
+
+    // info and parity are packed LSB first (bit i is bit i%8 of byte i/8). n_bits should divide by 8,
+    // parity should have room for n_bits + N_PARITY_PAD_BITS bits
+    static void encode(const unsigned char *info, size_t n_bits, const vector_int &interleaver, unsigned char *parity);
+
+    // Max-log-MAP decoder (positive LLR means bit 0). info holds the n_bits systematic LLRs, parity
+    // holds the n_bits + N_TAIL_BITS parity and tail LLRs laid out as encode() writes them.
+    // Iterating stops once the hard decisions don't change. Returns the number of iterations done.
+    int decode(const float *info, const float *parity, size_t n_bits, const vector_int &interleaver, int max_iterations, int *decoded);
+
+    // Decode with the plain float path metrics even where SIMD is available, to check one against the other
+    void set_scalar(bool scalar) { d_scalar = scalar; }
+
+private:
+    struct rsc_table_t {
+        unsigned char next_state[N_STATES][256];
+        unsigned char parity[N_STATES][256];
+        unsigned char tail_bit[N_STATES];
+        unsigned char tail_parity[N_STATES];
+        // Branch signs (+1 for bit 0, -1 for bit 1) of the systematic and parity bits, indexed by the
+        // target state for the forward recursion (origin state s'>>1 | x<<2) and by the origin state
+        // for the backward recursion (register input i)
+        float alpha_sys_sign[2][N_STATES];
+        float alpha_parity_sign[2][N_STATES];
+        float beta_sys_sign[2][N_STATES];
+        float beta_parity_sign[2][N_STATES];
+        int feedback_mask[N_STATES]; // -1 when register input 1 is the systematic bit 0 branch
+    };
+
+    // Soft in soft out decoding of a single constituent code. sys and apriori hold n LLRs, tail_sys and
+    // tail_parity the 3 tail steps. Writes the extrinsic LLRs. M holds the path metric operations
+    template <class M>
+    void siso_decode(const float *sys, const float *parity, const float *apriori, const float *tail_sys, const float *tail_parity, size_t n, float *extrinsic);
+
+    static const rsc_table_t &rsc_table();
+    static rsc_table_t calc_rsc_table();
+    static unsigned char rsc_encode(const unsigned char *bytes, size_t n_bytes, unsigned char *parity);
+    static void set_bit(unsigned char *data, size_t i, int bit) { data[i / 8] |= bit << (i % 8); }
+    static int get_bit(const unsigned char *data, size_t i) { return (data[i / 8] >> (i % 8)) & 1; }
+
+    // Decoder workspace, kept between calls to avoid reallocating per block
+    vector_float d_alpha;
+    vector_float d_sys2, d_parity1, d_parity2, d_apriori1, d_apriori2, d_extrinsic1, d_extrinsic2;
+    vector_int d_hard;
+    bool d_scalar;
+};
+
+} /* namespace light_plc */
+
+#endif /* _LIGHT_PLC_TURBO_CODEC */
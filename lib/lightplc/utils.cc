@@ -17,6 +17,7 @@
  */
  
 #include "defs.h"
+#include "bitstream.h"
 
 namespace light_plc {
 
@@ -37,4 +38,14 @@ unsigned long get_field(const vector_int &bit_vector, int bit_offset, int bit_wi
     return value;
 }
 
+void set_field(bitstream_t &bitstream, int bit_offset, int bit_width, unsigned long new_value) {
+    assert((new_value & ~bitstream_t::low_bits_mask(bit_width)) == 0);
+    bitstream.set_bits(bit_offset, bit_width, new_value);
+    return;
+}
+
+unsigned long get_field(const bitstream_t &bitstream, int bit_offset, int bit_width) {
+    return bitstream.get_bits(bit_offset, bit_width);
+}
+
 } /* namespace light_plc */
@@ -26,6 +26,7 @@
 #include <gnuradio/fft/fft.h>
 #include <volk/volk.h>
 #include <math.h>
+#include <stdexcept>
 
 namespace gr {
   namespace plc {
@@ -33,8 +34,16 @@ namespace gr {
     const int phy_rx_impl::SYNCP_SIZE = light_plc::phy_service::SYNCP_SIZE;
     const int phy_rx_impl::PREAMBLE_SIZE = light_plc::phy_service::PREAMBLE_SIZE;
     const int phy_rx_impl::FRAME_CONTROL_SIZE = light_plc::phy_service::FRAME_CONTROL_SIZE;
+    const int phy_rx_impl::PAYLOAD_SYMBOL_SIZE = light_plc::phy_service::PAYLOAD_SYMBOL_SIZE;
     const int phy_rx_impl::MAX_SEARCH_LENGTH = 16384; // maximum search length determines the volk memory allocation
     const int phy_rx_impl::COARSE_SYNC_LENGTH = 2 * phy_rx_impl::SYNCP_SIZE + light_plc::phy_service::ROLLOFF_INTERVAL; // length for frame alignment attempt
+    const int phy_rx_impl::FINE_SYNC_LENGTH = phy_rx_impl::SYNCP_SIZE; // frame start offsets tried around the coarse one
+    const int phy_rx_impl::SQUELCH_BLOCK_SIZE = phy_rx_impl::SYNCP_SIZE; // samples per squelch energy measurement
+    const int phy_rx_impl::SQUELCH_LOOKBACK = 2; // quiet blocks kept before a loud one, they may hold the start of the preamble
+    const float phy_rx_impl::SQUELCH_FLOOR_RISE = 0.05; // noise floor step towards the energy of a search that found nothing
+    const int phy_rx_impl::NOISE_WINDOW_INTERVAL = 4 * IEEE1901_NUMBER_OF_CARRIERS; // quiet samples between noise windows
+    const float phy_rx_impl::NOISE_PSD_ALPHA = 0.1; // weight of a new noise window in the average
+    const float phy_rx_impl::NOISE_WINDOW_MAX_RISE = 4; // energy over the last window beyond which a window is not taken during a hold-off
     const int phy_rx_impl::MIN_PLATEAU = 5.5 * phy_rx_impl::SYNCP_SIZE - light_plc::phy_service::ROLLOFF_INTERVAL; // minimum autocorrelation plateau
 
     phy_rx::sptr
@@ -52,15 +61,41 @@ namespace gr {
               gr::io_signature::make(1, 1, sizeof(gr_complex)),
               gr::io_signature::make(0, 0, 0)),
             d_threshold(threshold),
+            d_threshold_sq(threshold * std::fabs(threshold)),
             d_interframe_space(light_plc::phy_service::MIN_INTERFRAME_SPACE),
             d_log_level(log_level),
             d_qpsk_tone_mask(light_plc::tone_mask_t()),
             d_init_done(false),
-            d_receiver_state(HALT)
+            d_receiver_state(HALT),
+            d_mult(NULL),
+            d_real(NULL),
+            d_energy(NULL),
+            d_corr_sums(NULL),
+            d_energy_a_sums(NULL),
+            d_energy_b_sums(NULL),
+            d_energy_products(NULL),
+            d_squelch_level(0),
+            d_noise_floor(0),
+            d_frame(NULL),
+            d_skip_samples(0),
+            d_frame_decoder(0),
+            d_next_decoder(0),
+            d_n_frames(0),
+            d_stop_decoders(false),
+            d_next_publish(0),
+            d_last_published(NO_FRAME),
+            d_last_decoder(0),
+            d_tone_map_version(0),
+            d_quiet_samples(0),
+            d_next_noise_window(PREAMBLE_SIZE + IEEE1901_NUMBER_OF_CARRIERS),
+            d_noise_hold_off(0),
+            d_noise_window_energy(0),
+            d_noise_psd_valid(false)
     {
       message_port_register_out(pmt::mp("mac out"));
       message_port_register_in(pmt::mp("mac in"));
       set_msg_handler(pmt::mp("mac in"), boost::bind(&phy_rx_impl::mac_in, this, _1));
+      set_output_multiple(2 * SYNCP_SIZE); // RESET needs two SYNCP, and SEARCH makes little progress on less
     }
 
     /*
@@ -68,13 +103,24 @@ namespace gr {
      */
     phy_rx_impl::~phy_rx_impl()
     {
-      volk_free(d_buffer);
+      {
+        std::lock_guard<std::mutex> lock(d_wakeup_mutex);
+        d_stop_decoders = true;
+      }
+      for (size_t k = 0; k < d_decoders.size(); k++) {
+        d_decoders[k]->wakeup_cond.notify_all();
+        d_decoders[k]->thread.join();
+      }
+      d_noise_cond.notify_all();
+      if (d_noise_thread.joinable())
+        d_noise_thread.join();
       volk_free(d_mult);
       volk_free(d_real);
       volk_free(d_energy);
-      volk_free(d_frame_control);
-      volk_free(d_corr_history);
-      volk_free(d_energy_history);
+      volk_free(d_corr_sums);
+      volk_free(d_energy_a_sums);
+      volk_free(d_energy_b_sums);
+      volk_free(d_energy_products);
     }
 
     void phy_rx_impl::mac_in (pmt::pmt_t msg) {
@@ -84,28 +130,27 @@ namespace gr {
       std::string cmd = pmt::symbol_to_string(pmt::car(msg));
       pmt::pmt_t dict = pmt::cdr(msg);
 
-      if (cmd == "PHY-RXCALCTONEMAP.request") {
-        PRINT_DEBUG("recalculating tone map");
-        float target_ber = pmt::to_float(pmt::dict_ref(dict, pmt::mp("target_ber"), pmt::PMT_NIL));
-        light_plc::tone_map_t tone_map = d_phy_service.calculate_tone_map(target_ber, d_qpsk_tone_mask);
-        d_phy_service.set_tone_map(tone_map);
-        pmt::pmt_t tone_map_pmt = pmt::make_u8vector(tone_map.size(), 0);
-        size_t len;
-        uint8_t *tone_map_blob = (uint8_t*)pmt::u8vector_writable_elements(tone_map_pmt, len);
-        for (size_t j=0; j<len; j++)
-          tone_map_blob[j] = (uint8_t)tone_map[j];
-        pmt::pmt_t dict = pmt::make_dict();
-        dict = pmt::dict_add(dict, pmt::mp("tone_map"), tone_map_pmt);
-        message_port_pub(pmt::mp("mac out"), pmt::cons(pmt::mp("PHY-RXCALCTONEMAP.response"), dict));
-        PRINT_INFO_VECTOR(d_phy_service.stats.snr, "snr");
-      }
-
-      else if (cmd == "PHY-RXPOSTPROCESS") {
-        PRINT_DEBUG("post processing payload");
-        d_phy_service.post_process_ppdu();
-        PRINT_INFO_VAR(d_phy_service.stats.tone_mode, "toneMode");
-        PRINT_INFO_VAR(d_phy_service.stats.n_bits, "nBits");
-        PRINT_INFO_VAR(d_phy_service.stats.ber, "ber");
+      if (cmd == "PHY-RXCALCTONEMAP.request" || cmd == "PHY-RXPOSTPROCESS") {
+        // These work on the last published frame, so they run in the decoder thread that decoded it
+        if (!d_init_done)
+          return;
+        command_t command;
+        command.msg = msg;
+        size_t last_decoder;
+        {
+          std::lock_guard<std::mutex> lock(d_publish_mutex);
+          command.seq = d_last_published;
+          last_decoder = d_last_decoder;
+        }
+        if (command.seq == NO_FRAME) {
+          PRINT_NOTICE("no frame received yet, dropping " + cmd);
+          return;
+        }
+        decoder_t &decoder = *d_decoders[last_decoder];
+        if (decoder.commands.push(command))
+          notify_decoder(decoder);
+        else
+          PRINT_NOTICE("decoder command queue is full, dropping " + cmd);
       }
 
       else if (cmd == "PHY-RXINIT") {
@@ -119,6 +164,7 @@ namespace gr {
 
           light_plc::tone_mask_t tone_mask;
           light_plc::sync_tone_mask_t sync_tone_mask;
+          size_t n_decoders = 1;
           if (pmt::dict_has_key(dict,pmt::mp("broadcast_tone_mask")) &&
               pmt::dict_has_key(dict,pmt::mp("sync_tone_mask")))
           {
@@ -149,6 +195,52 @@ namespace gr {
             d_interframe_space = pmt::to_uint64(interframe_space_pmt);
 
             d_phy_service = light_plc::phy_service(tone_mask, tone_mask, sync_tone_mask, channel_est_mode, d_log_level >= 3);
+
+            // Set turbo decoder and its maximum number of iterations (optional)
+            light_plc::turbo_decoder_t turbo_decoder = light_plc::TD_ITPP;
+            int turbo_iterations = light_plc::phy_service::TURBO_DEFAULT_ITERATIONS;
+            if (pmt::dict_has_key(dict, pmt::mp("turbo_decoder"))) {
+              long value = pmt::to_long(pmt::dict_ref(dict, pmt::mp("turbo_decoder"), pmt::PMT_NIL));
+              if (value == light_plc::TD_ITPP || value == light_plc::TD_NATIVE)
+                turbo_decoder = (light_plc::turbo_decoder_t)value;
+              else
+                PRINT_NOTICE("unknown turbo decoder " + std::to_string(value) + ", using the default");
+            }
+            if (pmt::dict_has_key(dict, pmt::mp("turbo_iterations"))) {
+              long value = pmt::to_long(pmt::dict_ref(dict, pmt::mp("turbo_iterations"), pmt::PMT_NIL));
+              if (value > 0)
+                turbo_iterations = value;
+              else
+                PRINT_NOTICE("turbo iterations must be at least 1, using the default");
+            }
+            d_phy_service.set_turbo_decoder(turbo_decoder, turbo_iterations);
+            unsigned int decoder_threads = 1;
+            if (pmt::dict_has_key(dict, pmt::mp("decoder_threads"))) {
+              long value = pmt::to_long(pmt::dict_ref(dict, pmt::mp("decoder_threads"), pmt::PMT_NIL));
+              if (value > 0)
+                decoder_threads = value;
+              else
+                PRINT_NOTICE("decoder threads must be at least 1, using 1");
+            }
+            d_phy_service.set_decoder_threads(decoder_threads); // the pool is shared with the decoders' copies
+            if (pmt::dict_has_key(dict, pmt::mp("decoders"))) {
+              long value = pmt::to_long(pmt::dict_ref(dict, pmt::mp("decoders"), pmt::PMT_NIL));
+              if (value > 0)
+                n_decoders = value;
+              else
+                PRINT_NOTICE("decoders must be at least 1, using 1");
+            }
+
+            // Set squelch level in dB above the noise floor (optional, disabled by default)
+            if (pmt::dict_has_key(dict, pmt::mp("squelch"))) {
+              double squelch = pmt::to_double(pmt::dict_ref(dict, pmt::mp("squelch"), pmt::PMT_NIL));
+              d_squelch_level = std::pow(10, squelch / 10);
+              PRINT_INFO_VAR(squelch, "squelch (dB)");
+            }
+            PRINT_INFO_VAR(turbo_decoder, "turbo decoder");
+            PRINT_INFO_VAR(turbo_iterations, "turbo iterations");
+            PRINT_INFO_VAR(decoder_threads, "decoder threads");
+            PRINT_INFO_VAR(n_decoders, "decoders");
             PRINT_INFO_VAR(d_threshold, "threshold");
           }
 
@@ -162,19 +254,55 @@ namespace gr {
               d_qpsk_tone_mask[j] = tone_mask_blob[j];
           }
 
+          // The history is the only part that can fail, the receiver stays uninitialized if it does
+          try {
+            d_history.reset(new sample_ring(std::max(d_interframe_space, IEEE1901_NUMBER_OF_CARRIERS) + PREAMBLE_SIZE));
+          } catch (const std::runtime_error &e) {
+            PRINT_NOTICE(std::string("cannot init receiver: ") + e.what());
+            return;
+          }
+
           d_init_done = true;
 
           // Init some vectors
           unsigned int alignment = volk_get_alignment();
-          d_buffer_size = d_interframe_space + phy_rx_impl::PREAMBLE_SIZE;
-          d_buffer = (gr_complex*)volk_malloc(sizeof(gr_complex) * d_buffer_size, alignment); // buffer
+          d_fine_sync_window.resize(FINE_SYNC_LENGTH - 1 + light_plc::phy_service::FINE_SYNC_REFERENCE_SIZE);
           d_mult = (gr_complex*)volk_malloc(sizeof(gr_complex) * (MAX_SEARCH_LENGTH - SYNCP_SIZE), alignment); // for preamble correlation
-          d_real = (float*)volk_malloc(sizeof(float) * (MAX_SEARCH_LENGTH - SYNCP_SIZE), alignment); // real part of preamble correlation
-          d_energy = (float*)volk_malloc(sizeof(float) * MAX_SEARCH_LENGTH, alignment); // energy of preamble
+          d_real = (float*)volk_malloc(sizeof(float) * MAX_SEARCH_LENGTH, alignment); // real part of preamble correlation, after SYNCP_SIZE of history
+          d_energy = (float*)volk_malloc(sizeof(float) * (MAX_SEARCH_LENGTH + SYNCP_SIZE), alignment); // energy of preamble, after 2 * SYNCP_SIZE of history
+          d_corr_sums = (float*)volk_malloc(sizeof(float) * (MAX_SEARCH_LENGTH - SYNCP_SIZE), alignment);
+          d_energy_a_sums = (float*)volk_malloc(sizeof(float) * (MAX_SEARCH_LENGTH - SYNCP_SIZE), alignment);
+          d_energy_b_sums = (float*)volk_malloc(sizeof(float) * (MAX_SEARCH_LENGTH - SYNCP_SIZE), alignment);
+          d_energy_products = (float*)volk_malloc(sizeof(float) * (MAX_SEARCH_LENGTH - SYNCP_SIZE), alignment);
           assert (MAX_SEARCH_LENGTH > COARSE_SYNC_LENGTH + 2 * SYNCP_SIZE); // the volk vectors are used during SYNC as well
-          d_corr_history = (float*)volk_malloc(sizeof(float) * SYNCP_SIZE, alignment); // correlation history
-          d_energy_history = (float*)volk_malloc(sizeof(float) * 2 * SYNCP_SIZE, alignment); // energy history
-          d_frame_control = (gr_complex*)volk_malloc(sizeof(gr_complex) * FRAME_CONTROL_SIZE, alignment); // frame control
+
+          // Decoders, each with a copy of the phy_service and the frame buffers work() fills for it
+          for (size_t k = 0; k < n_decoders; k++) {
+            d_decoders.push_back(std::unique_ptr<decoder_t>(new decoder_t(d_phy_service)));
+            for (size_t j = 0; j < FRAMES_PER_DECODER; j++) {
+              rx_frame_t &frame = d_decoders[k]->frames[j];
+              frame.preamble.resize(PREAMBLE_SIZE);
+              frame.noise.resize(d_interframe_space);
+              frame.frame_control.resize(FRAME_CONTROL_SIZE);
+              frame.payload.resize(light_plc::phy_service::max_ppdu_payload_length());
+              d_decoders[k]->free_frames.push(&frame);
+            }
+          }
+          for (size_t k = 0; k < n_decoders; k++)
+            d_decoders[k]->thread = std::thread(&phy_rx_impl::decoder, this, k);
+
+          // Where a frame no decoder can take is copied, to find the length of its payload
+          d_dropped_frame.preamble.resize(PREAMBLE_SIZE);
+          d_dropped_frame.noise.resize(d_interframe_space);
+          d_dropped_frame.frame_control.resize(FRAME_CONTROL_SIZE);
+
+          // Background noise estimator, fed with the samples searched between frames
+          d_noise_phy_service.reset(new light_plc::phy_service(d_phy_service));
+          for (size_t j = 0; j < NOISE_WINDOWS; j++) {
+            d_noise_windows[j].resize(IEEE1901_NUMBER_OF_CARRIERS);
+            d_free_noise_windows.push(&d_noise_windows[j]);
+          }
+          d_noise_thread = std::thread(&phy_rx_impl::noise_estimator, this);
 
           d_receiver_state = RESET;
           PRINT_DEBUG("init done");
@@ -183,47 +311,269 @@ namespace gr {
       }
     }
 
+    void phy_rx_impl::feed_noise_estimator(int n) {
+      // Hand a window of the quiet samples just searched to the noise estimator. The window ends
+      // PREAMBLE_SIZE samples back, so it cannot hold the start of a preamble not found yet
+      static const int N = IEEE1901_NUMBER_OF_CARRIERS;
+      d_quiet_samples += n;
+      if (d_quiet_samples < d_next_noise_window)
+        return;
+      const gr_complex *samples = d_history->last(PREAMBLE_SIZE + N);
+      gr_complex energy;
+      volk_32fc_x2_conjugate_dot_prod_32fc(&energy, samples, samples, N);
+      // After a frame control that could not be parsed, a window much louder than the last one may be the payload
+      if (d_quiet_samples < d_noise_hold_off && !(energy.real() < NOISE_WINDOW_MAX_RISE * d_noise_window_energy)) {
+        d_next_noise_window = d_quiet_samples + NOISE_WINDOW_INTERVAL;
+        return;
+      }
+      light_plc::vector_complex *window;
+      if (!d_free_noise_windows.pop(window))
+        return;
+      memcpy(window->data(), samples, N * sizeof(gr_complex));
+      d_ready_noise_windows.push(window);
+      { std::lock_guard<std::mutex> lock(d_wakeup_mutex); }
+      d_noise_cond.notify_one();
+      d_noise_window_energy = energy.real();
+      d_next_noise_window = d_quiet_samples + NOISE_WINDOW_INTERVAL;
+    }
+
+    void phy_rx_impl::noise_estimator() {
+      // Average the periodograms of the noise windows, frames only take a snapshot of the estimate
+      bool first = true;
+      while (true) {
+        light_plc::vector_complex *window = NULL;
+        {
+          std::unique_lock<std::mutex> lock(d_wakeup_mutex);
+          d_noise_cond.wait(lock, [&] { return d_stop_decoders || d_ready_noise_windows.pop(window); });
+          if (d_stop_decoders)
+            return;
+        }
+        d_noise_phy_service->average_noise(window->begin(), first ? 1 : NOISE_PSD_ALPHA);
+        d_free_noise_windows.push(window);
+        first = false;
+        std::lock_guard<std::mutex> lock(d_noise_psd_mutex);
+        d_noise_psd = d_noise_phy_service->get_noise_psd();
+        d_noise_psd_valid = true;
+      }
+    }
+
+    void phy_rx_impl::decoder(size_t index) {
+      // Decode the frames work() dispatched to this decoder, so the sample stream never waits for the FEC
+      decoder_t &decoder = *d_decoders[index];
+      while (true) {
+        rx_frame_t *frame = NULL;
+        command_t command;
+        if (!wait_for_decoder_input(decoder, [&] { return decoder.commands.pop(command) || decoder.ready_frames.pop(frame); }))
+          return;
+        if (frame) {
+          {
+            // Catch up with the tone map calculated by another decoder
+            std::lock_guard<std::mutex> lock(d_tone_map_mutex);
+            if (decoder.tone_map_version != d_tone_map_version) {
+              decoder.phy_service.set_tone_map(d_tone_map);
+              decoder.tone_map_version = d_tone_map_version;
+            }
+          }
+          pmt::pmt_t dict = decode_frame(decoder, *frame);
+          if (pmt::is_dict(dict)) {
+            // Later frames may be decoded before the MAC asks about this one
+            frame_state_t &state = decoder.frame_states[decoder.next_frame_state++ % FRAME_STATES_PER_DECODER];
+            state.seq = frame->seq;
+            decoder.phy_service.save_rx_frame_state(state.rx_state);
+          }
+          publish(frame->seq, dict, index);
+          decoder.free_frames.push(frame); // never full, the decoder has only FRAMES_PER_DECODER frames
+        } else
+          decoder_command(decoder, command);
+      }
+    }
+
+    pmt::pmt_t phy_rx_impl::decode_frame(decoder_t &decoder, rx_frame_t &frame) {
+      // Returns the PHY-RXSTART dictionary, or PMT_NIL if the frame could not be decoded
+      light_plc::phy_service &phy_service = decoder.phy_service;
+
+      // Process preamble
+      phy_service.process_ppdu_preamble(frame.preamble.begin(), frame.preamble.end());
+
+      // Process noise, estimated in the background unless there was no estimate yet when the frame arrived
+      if (frame.noise_psd_valid)
+        phy_service.set_noise_psd(frame.noise_psd);
+      else
+        phy_service.process_noise(frame.noise.begin(), frame.noise.end());
+
+      // Print the calculated noise PSD
+      PRINT_INFO_VECTOR(phy_service.stats.noise_psd, "noisePsd");
+
+      pmt::pmt_t frame_control_pmt = pmt::make_u8vector(light_plc::phy_service::FRAME_CONTROL_SIZE, 0);
+      size_t len;
+      unsigned char *fc_blob = (unsigned char*)pmt::u8vector_writable_elements(frame_control_pmt, len);
+      if (phy_service.process_ppdu_frame_control(frame.frame_control.begin(), fc_blob) == false) {
+        PRINT_NOTICE("cannot parse frame control");
+        return pmt::PMT_NIL;
+      }
+      assert(phy_service.get_ppdu_payload_length() == frame.payload_size);
+
+      // Decode the payload symbol by symbol while work() is still copying it
+      for (int offset = 0; offset < frame.payload_size; offset += PAYLOAD_SYMBOL_SIZE) {
+        if (!wait_for_decoder_input(decoder, [&] { return frame.payload_copied.load(std::memory_order_acquire) >= offset + PAYLOAD_SYMBOL_SIZE; }))
+          return pmt::PMT_NIL;
+        phy_service.process_ppdu_payload_symbol(frame.payload.begin() + offset);
+      }
+
+      pmt::pmt_t payload_pmt = pmt::make_u8vector(phy_service.get_mpdu_payload_size(), 0);
+      unsigned char *payload_blob = (unsigned char*)pmt::u8vector_writable_elements(payload_pmt, len);
+      phy_service.get_mpdu_payload(payload_blob);      // get payload data
+      PRINT_INFO_VECTOR(phy_service.stats.channel, "channelCarriers");
+      PRINT_DEBUG("payload resolved. Payload size (bytes) = " + std::to_string(phy_service.get_mpdu_payload_size()));
+      pmt::pmt_t dict = pmt::make_dict();
+      dict = pmt::dict_add(dict, pmt::mp("frame_control"), frame_control_pmt);  // add frame control information
+      dict = pmt::dict_add(dict, pmt::mp("payload"), payload_pmt);
+      return dict;
+    }
+
+    void phy_rx_impl::publish(uint64_t seq, pmt::pmt_t frame, size_t decoder) {
+      // Frames are published in the order they arrived, a frame decoded early waits for the ones before it
+      std::lock_guard<std::mutex> lock(d_publish_mutex);
+      d_decoded_frames[seq] = std::make_pair(frame, decoder);
+      for (auto iter = d_decoded_frames.begin(); iter != d_decoded_frames.end() && iter->first == d_next_publish; d_next_publish++) {
+        if (pmt::is_dict(iter->second.first)) {
+          message_port_pub(pmt::mp("mac out"), pmt::cons(pmt::mp("PHY-RXSTART"), iter->second.first));
+          message_port_pub(pmt::mp("mac out"), pmt::cons(pmt::mp("PHY-RXEND"), pmt::make_dict()));
+          d_last_published = iter->first;
+          d_last_decoder = iter->second.second;
+        }
+        iter = d_decoded_frames.erase(iter);
+      }
+    }
+
+    void phy_rx_impl::decoder_command(decoder_t &decoder, const command_t &command) {
+      std::string cmd = pmt::symbol_to_string(pmt::car(command.msg));
+      pmt::pmt_t dict = pmt::cdr(command.msg);
+      light_plc::phy_service &phy_service = decoder.phy_service;
+
+      // Bring back the state of the frame the request is about
+      frame_state_t *state = NULL;
+      for (size_t k = 0; k < FRAME_STATES_PER_DECODER; k++)
+        if (decoder.frame_states[k].seq == command.seq)
+          state = &decoder.frame_states[k];
+      if (!state) {
+        PRINT_NOTICE("frame is too old, dropping " + cmd);
+        return;
+      }
+      phy_service.restore_rx_frame_state(state->rx_state);
+
+      if (cmd == "PHY-RXCALCTONEMAP.request") {
+        PRINT_DEBUG("recalculating tone map");
+        float target_ber = pmt::to_float(pmt::dict_ref(dict, pmt::mp("target_ber"), pmt::PMT_NIL));
+        light_plc::tone_map_t tone_map = phy_service.calculate_tone_map(target_ber, d_qpsk_tone_mask);
+        {
+          // The other decoders pick it up before their next frame
+          std::lock_guard<std::mutex> lock(d_tone_map_mutex);
+          d_tone_map = tone_map;
+          decoder.tone_map_version = ++d_tone_map_version;
+        }
+        phy_service.set_tone_map(tone_map);
+        pmt::pmt_t tone_map_pmt = pmt::make_u8vector(tone_map.size(), 0);
+        size_t len;
+        uint8_t *tone_map_blob = (uint8_t*)pmt::u8vector_writable_elements(tone_map_pmt, len);
+        for (size_t j=0; j<len; j++)
+          tone_map_blob[j] = (uint8_t)tone_map[j];
+        pmt::pmt_t dict = pmt::make_dict();
+        dict = pmt::dict_add(dict, pmt::mp("tone_map"), tone_map_pmt);
+        message_port_pub(pmt::mp("mac out"), pmt::cons(pmt::mp("PHY-RXCALCTONEMAP.response"), dict));
+        PRINT_INFO_VECTOR(phy_service.stats.snr, "snr");
+      }
+
+      else if (cmd == "PHY-RXPOSTPROCESS") {
+        PRINT_DEBUG("post processing payload");
+        phy_service.post_process_ppdu();
+        PRINT_INFO_VAR(phy_service.stats.tone_mode, "toneMode");
+        PRINT_INFO_VAR(phy_service.stats.n_bits, "nBits");
+        PRINT_INFO_VAR(phy_service.stats.ber, "ber");
+      }
+
+      // Post processing a sound frame updates the channel response the tone map is calculated from
+      phy_service.save_rx_frame_state(state->rx_state);
+    }
+
+    bool phy_rx_impl::wait_for_decoder_input(decoder_t &decoder, const std::function<bool()> &ready) {
+      // Returns false when the block is being destroyed
+      std::unique_lock<std::mutex> lock(d_wakeup_mutex);
+      decoder.wakeup_cond.wait(lock, [&] { return d_stop_decoders || ready(); });
+      return !d_stop_decoders;
+    }
+
+    void phy_rx_impl::notify_decoder(decoder_t &decoder) {
+      // Taking the mutex makes sure the decoder is not between checking for input and waiting
+      { std::lock_guard<std::mutex> lock(d_wakeup_mutex); }
+      decoder.wakeup_cond.notify_one();
+    }
+
+    int phy_rx_impl::min_input() const {
+      // Input the current state needs to run
+      switch (d_receiver_state) {
+        case SEARCH: return SYNCP_SIZE + 1;
+        case SYNC: return COARSE_SYNC_LENGTH + SYNCP_SIZE;
+        case COPY_PREAMBLE: return d_frame_start + FINE_SYNC_LENGTH / 2;
+        case COPY_FRAME_CONTROL: return FRAME_CONTROL_SIZE;
+        case RESET: return 2 * SYNCP_SIZE;
+        default: return 1;
+      }
+    }
+
     void
     phy_rx_impl::forecast (int noutput_items, gr_vector_int &ninput_items_required)
     {
-      if (d_receiver_state == SYNC) {
-        ninput_items_required[0] = COARSE_SYNC_LENGTH + SYNCP_SIZE;
-      } else if (d_receiver_state == COPY_PREAMBLE) {
-        ninput_items_required[0] = d_frame_start;
-      } else if (d_receiver_state == COPY_FRAME_CONTROL) {
-        ninput_items_required[0] = FRAME_CONTROL_SIZE;
-      } else if (d_receiver_state == RESET) {
-        ninput_items_required[0] = 2 * SYNCP_SIZE;
-      } else {
-        ninput_items_required[0] = noutput_items;
+      ninput_items_required[0] = std::max(noutput_items, min_input());
+    }
+
+    int phy_rx_impl::squelch(const gr_complex *in, int n) {
+      // Returns how many leading samples are quiet enough to skip the correlator. The blocks before the
+      // first one above the squelch level are skipped, except the last SQUELCH_LOOKBACK of them
+      int n_blocks = n / SQUELCH_BLOCK_SIZE;
+      int b = 0;
+      for (; b < n_blocks; b++) {
+        const gr_complex *block = in + b * SQUELCH_BLOCK_SIZE;
+        gr_complex energy;
+        volk_32fc_x2_conjugate_dot_prod_32fc(&energy, block, block, SQUELCH_BLOCK_SIZE);
+        if (d_noise_floor == 0)
+          d_noise_floor = energy.real();
+        if (energy.real() > d_squelch_level * d_noise_floor)
+          break;
+        // Follow the noise floor down quickly and up slowly
+        d_noise_floor += (energy.real() < d_noise_floor ? 0.1f : 0.01f) * (energy.real() - d_noise_floor);
       }
+      return std::max(b - SQUELCH_LOOKBACK, 0) * SQUELCH_BLOCK_SIZE;
     }
 
-    void phy_rx_impl::copy_to_circular_buffer(void *buffer, size_t buffer_size, size_t &buffer_offset, const void* src, size_t size, size_t datatype_size){
-      buffer_size *= datatype_size;
-      size *= datatype_size;
-      buffer_offset *= datatype_size;
-      buffer_offset = (buffer_offset + size) % buffer_size;
-      size_t count = std::min(buffer_size, size); // number of samples to copy
-      buffer_offset = (buffer_offset + buffer_size - count) % buffer_size;
-      const void *src_start = (const uint8_t *)src + size - count; // position of source first sample
-      size_t first_copy_count = std::min(count, buffer_size - buffer_offset); // length of first part
-      memcpy((uint8_t*)buffer + buffer_offset, src_start, first_copy_count); // copy first part
-      buffer_offset = (buffer_offset + first_copy_count) % buffer_size; // update offset pointer
-      memcpy((uint8_t*)buffer + buffer_offset, (uint8_t*)src_start + first_copy_count, count - first_copy_count); // copy second part (if exists)
-      buffer_offset = (buffer_offset + count - first_copy_count) % buffer_size; // update offset pointer
-      buffer_offset /= datatype_size;
+    void phy_rx_impl::sliding_correlation(const gr_complex *in, int n) {
+      // Correlation of in[j] with in[j + SYNCP_SIZE] and energies of both, for j in the window ending at each sample
+      volk_32fc_x2_multiply_conjugate_32fc(d_mult, in, in + SYNCP_SIZE, n);
+      volk_32fc_deinterleave_real_32f(d_real + SYNCP_SIZE, d_mult, n);
+      volk_32fc_magnitude_squared_32f(d_energy + 2 * SYNCP_SIZE, in + SYNCP_SIZE, n);
+
+      // Each window gains one sample and loses the one SYNCP_SIZE before it
+      volk_32f_x2_subtract_32f(d_corr_sums, d_real + SYNCP_SIZE, d_real, n);
+      volk_32f_x2_subtract_32f(d_energy_a_sums, d_energy + SYNCP_SIZE, d_energy, n);
+      volk_32f_x2_subtract_32f(d_energy_b_sums, d_energy + 2 * SYNCP_SIZE, d_energy + SYNCP_SIZE, n);
+      float corr = d_search_corr, energy_a = d_energy_a, energy_b = d_energy_b;
+      for (int j = 0; j < n; j++) {
+        d_corr_sums[j] = corr += d_corr_sums[j];
+        d_energy_a_sums[j] = energy_a += d_energy_a_sums[j];
+        d_energy_b_sums[j] = energy_b += d_energy_b_sums[j];
+      }
+      volk_32f_x2_multiply_32f(d_energy_products, d_energy_a_sums, d_energy_b_sums, n);
     }
 
-    void phy_rx_impl::copy_from_circular_buffer(void *dest, void *buffer, size_t buffer_size, size_t buffer_offset, size_t size, size_t datatype_size){
-      assert(size <= buffer_size); // cannot copy more than buffer size
-      buffer_size *= datatype_size;
-      size *= datatype_size;
-      buffer_offset *= datatype_size;
-      size_t start = (buffer_offset + buffer_size) % buffer_size; // first sample to copy
-      size_t first_copy_count = std::min(buffer_size - start, size); // length of first part
-      memcpy(dest, (uint8_t*)buffer + start, first_copy_count);  // copy first part
-      memcpy((uint8_t*)dest + first_copy_count, buffer, size - first_copy_count);  // copy second part (if exists)
+    void phy_rx_impl::consume_correlation(int n) {
+      // Advance the windows by n samples and keep the samples still inside them
+      if (n == 0)
+        return;
+      d_search_corr = d_corr_sums[n - 1];
+      d_energy_a = d_energy_a_sums[n - 1];
+      d_energy_b = d_energy_b_sums[n - 1];
+      memmove(d_real, d_real + n, sizeof(float) * SYNCP_SIZE);
+      memmove(d_energy, d_energy + n, sizeof(float) * 2 * SYNCP_SIZE);
     }
 
     int
@@ -231,179 +581,223 @@ namespace gr {
               gr_vector_const_void_star &input_items,
               gr_vector_void_star &output_items)
     {
-      const gr_complex *in = (const gr_complex *) input_items[0];
-      int ninput = noutput_items;
-      int i = 0;
-
-      switch(d_receiver_state) {
-
-        case SEARCH: {
-          int search_len = std::min(ninput, MAX_SEARCH_LENGTH);
-          volk_32fc_x2_multiply_conjugate_32fc(d_mult, in, in + SYNCP_SIZE, search_len - SYNCP_SIZE);
-          volk_32fc_deinterleave_real_32f(d_real, d_mult, search_len - SYNCP_SIZE);
-          volk_32fc_magnitude_squared_32f(d_energy, in + SYNCP_SIZE, search_len - SYNCP_SIZE);
-
-          float correlation = 0;
-          while (i < search_len - SYNCP_SIZE && d_plateau < MIN_PLATEAU) {
-            d_search_corr += d_real[i] - d_corr_history[d_corr_idx]; // update correlation window
-            int k = (d_energy_idx + SYNCP_SIZE) % (2 * SYNCP_SIZE);
-            d_energy_a += d_energy_history[k] - d_energy_history[d_energy_idx]; // update energy window
-            d_energy_b += d_energy[i] - d_energy_history[k]; // update energy window
-            d_corr_history[d_corr_idx] = d_real[i];
-            d_energy_history[d_energy_idx] = d_energy[i];
-            d_corr_idx = (d_corr_idx + 1) % SYNCP_SIZE;
-            d_energy_idx = (d_energy_idx + 1) % (2 * SYNCP_SIZE);
-            correlation = d_search_corr / std::sqrt(d_energy_a*d_energy_b);
-            if(!std::isinf(correlation) && correlation > d_threshold) {
-              d_plateau++;
-            } else { // correlation <= d_threshold
-              d_plateau = 0;
+      const gr_complex *in_items = (const gr_complex *) input_items[0];
+      int ninput_items = std::max(noutput_items, min_input()); // forecast() made sure this much input is available
+      int consumed = 0;
+
+      // Run as many states as the input allows, instead of returning to the scheduler after each one
+      while (d_receiver_state != HALT && ninput_items - consumed >= min_input()) {
+        const gr_complex *in = in_items + consumed;
+        int ninput = ninput_items - consumed;
+        int i = 0;
+
+        switch(d_receiver_state) {
+
+          case SEARCH: {
+            // Skip the quiet blocks, RESET restarts the correlation windows after them
+            if (d_squelch_level > 0 && d_plateau == 0) {
+              i = squelch(in, ninput);
+              if (i > 0) {
+                d_history->write(in, i);
+                feed_noise_estimator(i);
+                d_receiver_state = RESET;
+                break;
+              }
             }
-            i++;
-          }
-          copy_to_circular_buffer(d_buffer, d_buffer_size, d_buffer_offset, in, i, sizeof(gr_complex));
-
-          // If plateau length is reached...
-          if (d_plateau == MIN_PLATEAU) {
-            PRINT_DEBUG("state = SEARCH, Found frame!");
-            d_sync_min = correlation;
-            d_sync_min_index = -1;
-            d_receiver_state = SYNC;
-          }
-          break;
-        }
 
-        case SYNC: {
-          // Perform coarse sync
-          volk_32fc_x2_multiply_conjugate_32fc(d_mult, in, in + SYNCP_SIZE, COARSE_SYNC_LENGTH);
-          volk_32fc_deinterleave_real_32f(d_real, d_mult, COARSE_SYNC_LENGTH);
-          volk_32fc_magnitude_squared_32f(d_energy, in + SYNCP_SIZE, COARSE_SYNC_LENGTH);
-          while (i < COARSE_SYNC_LENGTH && i - d_sync_min_index < 5 * (SYNCP_SIZE / 2)) {
-            d_search_corr += d_real[i] - d_corr_history[d_corr_idx]; // update correlation window
-            int k = (d_energy_idx + SYNCP_SIZE) % (2 * SYNCP_SIZE);
-            d_energy_a += d_energy_history[k] - d_energy_history[d_energy_idx]; // update energy window
-            d_energy_b += d_energy[i] - d_energy_history[k]; // update energy window
-            d_corr_history[d_corr_idx] = d_real[i];
-            d_energy_history[d_energy_idx] = d_energy[i];
-            d_corr_idx = (d_corr_idx + 1) % SYNCP_SIZE;
-            d_energy_idx = (d_energy_idx + 1) % (2 * SYNCP_SIZE);
-            i++;
-            float correlation = d_search_corr / std::sqrt(d_energy_a * d_energy_b);
-            if (correlation < d_sync_min) {
-                d_sync_min = correlation;
-                d_sync_min_index = i;
+            int search_len = std::min(ninput, MAX_SEARCH_LENGTH) - SYNCP_SIZE;
+            sliding_correlation(in, search_len);
+
+            // Look for a run of MIN_PLATEAU samples above the threshold
+            while (i < search_len && d_plateau < MIN_PLATEAU) {
+              d_plateau = above_threshold(d_corr_sums[i], d_energy_products[i]) ? d_plateau + 1 : 0;
+              i++;
             }
+            consume_correlation(i);
+            d_history->write(in, i);
+            feed_noise_estimator(i);
+
+            // The squelch let through a search that found nothing. If the noise got louder, raise the floor
+            // towards the energy of the last block searched, or the squelch would stay open for good
+            if (d_squelch_level > 0 && d_plateau == 0 && d_energy_b > d_noise_floor)
+              d_noise_floor += SQUELCH_FLOOR_RISE * (d_energy_b - d_noise_floor);
+
+            // If plateau length is reached...
+            if (d_plateau == MIN_PLATEAU) {
+              PRINT_DEBUG("state = SEARCH, Found frame!");
+              d_quiet_samples = 0;
+              d_next_noise_window = PREAMBLE_SIZE + IEEE1901_NUMBER_OF_CARRIERS;
+              d_noise_hold_off = 0;
+              d_sync_min = d_search_corr / std::sqrt(d_energy_a * d_energy_b);
+              d_sync_min_index = -1;
+              d_receiver_state = SYNC;
+            }
+            break;
           }
-          d_frame_start = 5 * (SYNCP_SIZE / 2) - (i - d_sync_min_index); // start of frame is at 2.5xSYNCP after minimum
-          copy_to_circular_buffer(d_buffer, d_buffer_size, d_buffer_offset, in, i, sizeof(gr_complex));
-          PRINT_DEBUG("state = SYNC, min = " + std::to_string(d_sync_min));
-          d_receiver_state = COPY_PREAMBLE;
-          break;
-        }
-
-        case COPY_PREAMBLE: {
-          PRINT_DEBUG("state = COPY_PREAMBLE");
-          i += d_frame_start;
-          copy_to_circular_buffer(d_buffer, d_buffer_size, d_buffer_offset, in, i, sizeof(gr_complex));
 
-          // Process preamble
-          light_plc::vector_complex preamble_aligned (PREAMBLE_SIZE);
-          copy_from_circular_buffer(preamble_aligned.data(), d_buffer, d_buffer_size, d_buffer_offset - PREAMBLE_SIZE, PREAMBLE_SIZE, sizeof(gr_complex));
-          d_phy_service.process_ppdu_preamble(preamble_aligned.begin(), preamble_aligned.end());
+          case SYNC: {
+            // Perform coarse sync
+            sliding_correlation(in, COARSE_SYNC_LENGTH);
+            // Stop early enough for fine sync to move the frame start back by FINE_SYNC_LENGTH / 2
+            while (i < COARSE_SYNC_LENGTH && i - d_sync_min_index < 5 * (SYNCP_SIZE / 2) - FINE_SYNC_LENGTH / 2) {
+              float correlation = d_corr_sums[i] / std::sqrt(d_energy_products[i]);
+              i++;
+              if (correlation < d_sync_min) {
+                  d_sync_min = correlation;
+                  d_sync_min_index = i;
+              }
+            }
+            consume_correlation(i);
+            d_frame_start = 5 * (SYNCP_SIZE / 2) - (i - d_sync_min_index); // start of frame is at 2.5xSYNCP after minimum
+            d_history->write(in, i);
+            PRINT_DEBUG("state = SYNC, min = " + std::to_string(d_sync_min));
+            d_receiver_state = COPY_PREAMBLE;
+            break;
+          }
 
-          // Process noise
-          light_plc::vector_complex noise_aligned (d_interframe_space);
-          copy_from_circular_buffer(noise_aligned.data(), d_buffer, d_buffer_size, d_buffer_offset - PREAMBLE_SIZE - d_interframe_space, d_interframe_space, sizeof(gr_complex));
-          d_phy_service.process_noise(noise_aligned.begin(), noise_aligned.end());
+          case COPY_PREAMBLE: {
+            PRINT_DEBUG("state = COPY_PREAMBLE");
+
+            // Refine the frame start to the sample by cross-correlating with the known preamble. The window
+            // covers the reference at every offset from -FINE_SYNC_LENGTH / 2 to FINE_SYNC_LENGTH / 2 - 1 and
+            // begins in the history
+            int window_start = d_frame_start - PREAMBLE_SIZE + light_plc::phy_service::FINE_SYNC_REFERENCE_OFFSET - FINE_SYNC_LENGTH / 2;
+            assert(window_start < 0 && (int)d_fine_sync_window.size() + window_start <= d_frame_start);
+            memcpy(d_fine_sync_window.data(), d_history->last(-window_start), -window_start * sizeof(gr_complex));
+            memcpy(d_fine_sync_window.data() - window_start, in, (d_fine_sync_window.size() + window_start) * sizeof(gr_complex));
+            int fine_offset = d_phy_service.fine_sync(d_fine_sync_window.begin(), FINE_SYNC_LENGTH) - FINE_SYNC_LENGTH / 2;
+            PRINT_DEBUG("fine sync offset = " + std::to_string(fine_offset));
+            i += d_frame_start + fine_offset;
+            d_history->write(in, i);
+
+            // Take a free frame buffer from the next decoder that has one, unless the last frame control
+            // could not be parsed and left one
+            for (size_t k = 0; !d_frame && k < d_decoders.size(); k++) {
+              d_frame_decoder = (d_next_decoder + k) % d_decoders.size();
+              d_decoders[d_frame_decoder]->free_frames.pop(d_frame);
+            }
+            // If there is none the frame is dropped, but its frame control is still parsed to skip its payload,
+            // which would otherwise be searched and taken for noise
+            if (!d_frame) {
+              PRINT_NOTICE("state = COPY_PREAMBLE, decoders are busy, dropping frame");
+              d_frame = &d_dropped_frame;
+            }
 
-          // Print the calculated noise PSD
-          PRINT_INFO_VECTOR(d_phy_service.stats.noise_psd, "noisePsd");
+            // Snapshot the noise PSD estimate, or copy the noise before the preamble if there is none yet
+            {
+              std::lock_guard<std::mutex> lock(d_noise_psd_mutex);
+              d_frame->noise_psd_valid = d_noise_psd_valid;
+              if (d_noise_psd_valid)
+                d_frame->noise_psd = d_noise_psd;
+            }
+            if (!d_frame->noise_psd_valid)
+              memcpy(d_frame->noise.data(), d_history->last(d_interframe_space + PREAMBLE_SIZE), d_interframe_space * sizeof(gr_complex));
+
+            // Copy the preamble for the decoder, it is also needed here to parse the frame control, as is the noise
+            memcpy(d_frame->preamble.data(), d_history->last(PREAMBLE_SIZE), PREAMBLE_SIZE * sizeof(gr_complex));
+            d_phy_service.process_ppdu_preamble(d_frame->preamble.begin(), d_frame->preamble.end());
+            if (d_frame->noise_psd_valid)
+              d_phy_service.set_noise_psd(d_frame->noise_psd);
+            else
+              d_phy_service.process_noise(d_frame->noise.begin(), d_frame->noise.end());
+
+            d_receiver_state = COPY_FRAME_CONTROL;
+            break;
+          }
 
-          d_receiver_state = COPY_FRAME_CONTROL;
-          break;
-        }
+          case COPY_FRAME_CONTROL: {
+            PRINT_DEBUG("state = COPY_FRAME_CONTROL");
+            memcpy(d_frame->frame_control.data(), in, FRAME_CONTROL_SIZE * sizeof(gr_complex));
+            i += FRAME_CONTROL_SIZE;
+
+            // Only the payload length is needed here, the decoder thread decodes the frame control again
+            if (d_phy_service.process_ppdu_frame_control(d_frame->frame_control.begin()) == false) {
+              PRINT_NOTICE("state = COPY_FRAME_CONTROL, cannot parse frame control");
+              // A payload of unknown length may follow, feed_noise_estimator() holds off until the longest one is over
+              d_noise_hold_off = d_quiet_samples + light_plc::phy_service::max_ppdu_payload_length();
+              if (d_frame == &d_dropped_frame)
+                d_frame = NULL;
+              d_receiver_state = RESET; // a decoder's d_frame is kept for the next frame
+            } else if (d_frame == &d_dropped_frame) {
+              d_skip_samples = d_phy_service.get_ppdu_payload_length();
+              d_frame = NULL;
+              d_receiver_state = SKIP_PAYLOAD;
+            } else {
+              d_frame->payload_size = d_phy_service.get_ppdu_payload_length();
+              d_frame->payload_copied.store(0, std::memory_order_relaxed);
+              d_frame->seq = d_n_frames++;
+              d_decoders[d_frame_decoder]->ready_frames.push(d_frame); // never full, the decoder has only FRAMES_PER_DECODER frames
+              notify_decoder(*d_decoders[d_frame_decoder]);
+              d_next_decoder = (d_frame_decoder + 1) % d_decoders.size();
+              d_receiver_state = COPY_PAYLOAD;
+              PRINT_DEBUG("frame control is OK!");
+            }
+            break;
+          }
 
-        case COPY_FRAME_CONTROL: {
-          PRINT_DEBUG("state = COPY_FRAME_CONTROL");
-          memcpy(d_frame_control, in, FRAME_CONTROL_SIZE * sizeof(gr_complex));
-          i += FRAME_CONTROL_SIZE;
-
-          d_frame_control_pmt = pmt::make_u8vector(light_plc::phy_service::FRAME_CONTROL_SIZE, 0);
-          size_t len;
-          unsigned char *fc_blob = (unsigned char*)pmt::u8vector_writable_elements(d_frame_control_pmt, len);
-          if (d_phy_service.process_ppdu_frame_control((light_plc::vector_complex::const_iterator)d_frame_control, fc_blob) == false) {
-            PRINT_NOTICE("state = COPY_FRAME_CONTROL, cannot parse frame control");
-            d_receiver_state = RESET;
-          } else {
-            d_receiver_state = COPY_PAYLOAD;
-            d_payload_size = d_phy_service.get_ppdu_payload_length();
-            PRINT_DEBUG("frame control is OK!");
-            d_payload = (gr_complex*)volk_malloc(sizeof(gr_complex) * d_payload_size, volk_get_alignment());
+          case COPY_PAYLOAD: {
+            // Copy the payload for the decoder thread, which decodes each symbol as soon as it is complete
+            int copied = d_frame->payload_copied.load(std::memory_order_relaxed);
+            i = std::min(d_frame->payload_size - copied, ninput);
+            memcpy(d_frame->payload.data() + copied, in, i * sizeof(gr_complex));
+            d_frame->payload_copied.store(copied + i, std::memory_order_release);
+            if ((copied + i) / PAYLOAD_SYMBOL_SIZE > copied / PAYLOAD_SYMBOL_SIZE)
+              notify_decoder(*d_decoders[d_frame_decoder]);
+            if (copied + i == d_frame->payload_size) {
+              PRINT_DEBUG("payload copied. Payload length = " + std::to_string(d_frame->payload_size));
+              d_frame = NULL; // the decoder thread returns it when done
+              d_receiver_state = RESET;
+            }
+            break;
           }
-          break;
-        }
 
-        case COPY_PAYLOAD: {
-          i = std::min(d_payload_size - d_payload_offset, ninput);
-          memcpy(d_payload + d_payload_offset, in, i * sizeof(gr_complex));
-          d_payload_offset += i;
-          if (d_payload_offset == d_payload_size) {
-            pmt::pmt_t payload_pmt = pmt::make_u8vector(d_phy_service.get_mpdu_payload_size(), 0);
-            size_t len;
-            unsigned char *payload_blob = (unsigned char*)pmt::u8vector_writable_elements(payload_pmt, len);
-            d_phy_service.process_ppdu_payload((light_plc::vector_complex::iterator)d_payload, payload_blob);      // get payload data
-            PRINT_INFO_VECTOR(d_phy_service.stats.channel, "channelCarriers");
-            PRINT_DEBUG("payload resolved. Payload size (bytes) = " + std::to_string(d_phy_service.get_mpdu_payload_size()));
-            pmt::pmt_t dict = pmt::make_dict();
-            dict = pmt::dict_add(dict, pmt::mp("frame_control"), d_frame_control_pmt);  // add frame control information
-            dict = pmt::dict_add(dict, pmt::mp("payload"), payload_pmt);
-            message_port_pub(pmt::mp("mac out"), pmt::cons(pmt::mp("PHY-RXSTART"), dict));
-
-            dict = pmt::make_dict();
-            message_port_pub(pmt::mp("mac out"), pmt::cons(pmt::mp("PHY-RXEND"), dict));
-            volk_free(d_payload);
-            d_receiver_state = RESET;
+          case SKIP_PAYLOAD: {
+            // The payload of a dropped frame is neither searched nor fed to the noise estimator
+            i = std::min(d_skip_samples, ninput);
+            d_skip_samples -= i;
+            if (d_skip_samples == 0) {
+              PRINT_DEBUG("payload skipped. Payload length = " + std::to_string(d_phy_service.get_ppdu_payload_length()));
+              d_receiver_state = RESET;
+            }
+            break;
           }
-          break;
-        }
 
-        case RESET: {
-          PRINT_DEBUG ("state = RESET");
-          d_sync_min = 1;
-          d_buffer_offset = 0;
-          d_payload_size = 0;
-          d_payload_offset = 0;
-          d_search_corr = 0;
-          d_energy_a = 0;
-          d_energy_b = 0;
-          d_corr_idx = 0;
-          d_energy_idx = 0;
-          volk_32fc_x2_multiply_conjugate_32fc(d_mult, in, in + SYNCP_SIZE, SYNCP_SIZE);
-          volk_32fc_deinterleave_real_32f(d_corr_history, d_mult, SYNCP_SIZE);
-          volk_32fc_magnitude_squared_32f(d_energy_history, in, 2 * SYNCP_SIZE);
-          while (i < SYNCP_SIZE) {
-            d_search_corr += d_corr_history[i]; // update correlation window
-            d_energy_a += d_energy_history[i]; // update energy window
-            d_energy_b += d_energy_history[i + SYNCP_SIZE]; // update energy window
-            i++;
+          case RESET: {
+            PRINT_DEBUG ("state = RESET");
+            d_sync_min = 1;
+            d_search_corr = 0;
+            d_energy_a = 0;
+            d_energy_b = 0;
+            volk_32fc_x2_multiply_conjugate_32fc(d_mult, in, in + SYNCP_SIZE, SYNCP_SIZE);
+            volk_32fc_deinterleave_real_32f(d_real, d_mult, SYNCP_SIZE);
+            volk_32fc_magnitude_squared_32f(d_energy, in, 2 * SYNCP_SIZE);
+            while (i < SYNCP_SIZE) {
+              d_search_corr += d_real[i]; // update correlation window
+              d_energy_a += d_energy[i]; // update energy window
+              d_energy_b += d_energy[i + SYNCP_SIZE]; // update energy window
+              i++;
+            }
+            d_plateau = above_threshold(d_search_corr, d_energy_a * d_energy_b) ? 1 : 0; // set d_plateau=1 if correlation above threshold
+            d_history->write(in, i);
+            feed_noise_estimator(i);
+            d_receiver_state = SEARCH;
+            break;
           }
-          d_plateau = d_search_corr / std::sqrt(d_energy_a*d_energy_b) > d_threshold ? 1 : 0; // set d_plateau=1 if correlation above threshold
-          copy_to_circular_buffer(d_buffer, d_buffer_size, d_buffer_offset, in, i, sizeof(gr_complex));
-          d_receiver_state = SEARCH;
-          break;
-        }
 
-       case IDLE:
-         PRINT_DEBUG ("state = IDLE, ninput = " +  std::to_string(ninput));
-         i = ninput;
+         case IDLE:
+           PRINT_DEBUG ("state = IDLE, ninput = " +  std::to_string(ninput));
+           i = ninput;
 
-        case HALT:
-            break;
+          case HALT:
+              break;
+        }
+
+        consumed += i;
       }
 
       // Tell runtime system how many input items we consumed on
       // each input stream.
-      consume_each (i);
+      consume_each (consumed);
       return 0;
     }
 
@@ -21,57 +21,167 @@
 
 #include <plc/phy_rx.h>
 #include <lightplc/phy_service.h>
+#include "sample_ring.h"
+#include "spsc_queue.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 #include <list>
+#include <map>
+#include <memory>
 #include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace gr {
   namespace plc {
 
+    class qa_phy_rx;
+
     class phy_rx_impl : public phy_rx
     {
+      friend class qa_phy_rx;
+
      private:
       static const int SYNCP_SIZE;
       static const int COARSE_SYNC_LENGTH;
       static const int FINE_SYNC_LENGTH;
       static const int PREAMBLE_SIZE;
       static const int FRAME_CONTROL_SIZE;
+      static const int PAYLOAD_SYMBOL_SIZE;
       static const float THRESHOLD;
       static const int MIN_PLATEAU;
       static const int SILENCE_PERIOD;
       static const size_t BUFFER_SIZE;
       static const int MAX_SEARCH_LENGTH;
+      static const int SQUELCH_BLOCK_SIZE;
+      static const int SQUELCH_LOOKBACK;
+      static const float SQUELCH_FLOOR_RISE;
+      static const size_t FRAMES_PER_DECODER = 4;
+      static const uint64_t NO_FRAME = UINT64_MAX;
+      static const size_t MAX_PENDING_COMMANDS = 16;
+      static const size_t FRAME_STATES_PER_DECODER = FRAMES_PER_DECODER + 1;
+      static const size_t NOISE_WINDOWS = 4;
+      static const int NOISE_WINDOW_INTERVAL;
+      static const float NOISE_PSD_ALPHA;
+      static const float NOISE_WINDOW_MAX_RISE;
+
+      // A frame copied by work() for a decoder
+      typedef struct rx_frame_t {
+        light_plc::vector_complex preamble;
+        light_plc::tones_float_t noise_psd; // background estimate when the frame arrived
+        bool noise_psd_valid; // false if there was no estimate yet
+        light_plc::vector_complex noise; // interframe space before the preamble, copied only without an estimate
+        light_plc::vector_complex frame_control;
+        light_plc::vector_complex payload; // sized for the longest payload
+        int payload_size;
+        std::atomic<int> payload_copied; // payload samples copied so far
+        uint64_t seq; // arrival order
+      } rx_frame_t;
+
+      // The receiver state of a decoded frame, kept for the MAC requests that follow it
+      typedef struct frame_state_t {
+        frame_state_t() : seq(NO_FRAME) {}
+        uint64_t seq;
+        light_plc::phy_service::rx_frame_state_t rx_state;
+      } frame_state_t;
 
-      light_plc::phy_service d_phy_service;
+      // A MAC request and the frame it is about
+      typedef struct command_t {
+        pmt::pmt_t msg;
+        uint64_t seq;
+      } command_t;
+
+      // A decoder thread with its own copy of the phy_service and its own frame buffers
+      typedef struct decoder_t {
+        explicit decoder_t(const light_plc::phy_service &phy) : phy_service(phy), next_frame_state(0), tone_map_version(0) {}
+        light_plc::phy_service phy_service;
+        std::array<rx_frame_t, FRAMES_PER_DECODER> frames;
+        spsc_queue<rx_frame_t*, FRAMES_PER_DECODER> ready_frames; // copied by work(), waiting to be decoded
+        spsc_queue<rx_frame_t*, FRAMES_PER_DECODER> free_frames; // decoded, back to work()
+        spsc_queue<command_t, MAX_PENDING_COMMANDS> commands; // MAC requests for this decoder
+        std::array<frame_state_t, FRAME_STATES_PER_DECODER> frame_states; // last frames decoded, oldest overwritten first
+        size_t next_frame_state;
+        std::condition_variable wakeup_cond; // signaled when a frame, a payload symbol or a command arrives
+        std::thread thread;
+        unsigned int tone_map_version; // version of d_tone_map set in phy_service
+      } decoder_t;
+
+      light_plc::phy_service d_phy_service; // parses the frame control in work(), to find the end of the frame
       const float d_threshold;
+      const float d_threshold_sq; // d_threshold * |d_threshold|, compared against the squared correlation
       int d_interframe_space;
       const int d_log_level;
-      int d_buffer_size;
       light_plc::tone_mask_t d_qpsk_tone_mask;
       bool d_init_done;
-      enum {SEARCH, SYNC, COPY_PREAMBLE, COPY_FRAME_CONTROL, COPY_PAYLOAD, RESET, IDLE, HALT} d_receiver_state;
+      enum {SEARCH, SYNC, COPY_PREAMBLE, COPY_FRAME_CONTROL, COPY_PAYLOAD, SKIP_PAYLOAD, RESET, IDLE, HALT} d_receiver_state;
       float d_search_corr;
       float d_energy_a, d_energy_b;
-      gr_complex *d_mult, *d_buffer, *d_frame_control, *d_payload;
-      float *d_real, *d_energy, *d_corr_history, *d_energy_history;
+      gr_complex *d_mult;
+      std::unique_ptr<sample_ring> d_history; // last samples, holds the preamble and the noise before it
+      float *d_real, *d_energy; // preceded by the samples still inside the correlation windows
+      float *d_corr_sums, *d_energy_a_sums, *d_energy_b_sums, *d_energy_products; // windows after each sample
       int d_plateau;
-      int d_payload_size;
-      int d_payload_offset;
-      pmt::pmt_t d_frame_control_pmt;
+      float d_squelch_level; // block energy over the noise floor that opens the squelch, 0 if disabled
+      float d_noise_floor; // tracked energy of a quiet block
       float d_sync_min;
       int d_sync_min_index;
-      size_t d_buffer_offset;
       int d_frame_start;
-      int d_corr_idx, d_energy_idx;
+      light_plc::vector_complex d_fine_sync_window; // samples around the coarse frame start
+      rx_frame_t *d_frame; // frame being copied, NULL if none
+      rx_frame_t d_dropped_frame; // holds a frame no decoder could take until its frame control is parsed
+      int d_skip_samples; // payload samples of the dropped frame left to skip
+      size_t d_frame_decoder; // decoder of d_frame
+      size_t d_next_decoder; // frames are dispatched round-robin
+      uint64_t d_n_frames; // frames dispatched so far
+      std::vector<std::unique_ptr<decoder_t> > d_decoders;
+      std::mutex d_wakeup_mutex;
+      bool d_stop_decoders; // guarded by d_wakeup_mutex
+      std::mutex d_publish_mutex;
+      std::map<uint64_t, std::pair<pmt::pmt_t, size_t> > d_decoded_frames; // PHY-RXSTART and decoder of the frames waiting for the ones before them, guarded by d_publish_mutex
+      uint64_t d_next_publish; // next frame to publish, guarded by d_publish_mutex
+      uint64_t d_last_published; // last published frame, NO_FRAME if none, guarded by d_publish_mutex
+      size_t d_last_decoder; // decoder of the last published frame, guarded by d_publish_mutex
+      std::mutex d_tone_map_mutex;
+      light_plc::tone_map_t d_tone_map; // last calculated tone map, guarded by d_tone_map_mutex
+      unsigned int d_tone_map_version; // guarded by d_tone_map_mutex
+      std::unique_ptr<light_plc::phy_service> d_noise_phy_service; // keeps the running noise PSD estimate
+      std::array<light_plc::vector_complex, NOISE_WINDOWS> d_noise_windows;
+      spsc_queue<light_plc::vector_complex*, NOISE_WINDOWS> d_ready_noise_windows; // quiet samples taken by work()
+      spsc_queue<light_plc::vector_complex*, NOISE_WINDOWS> d_free_noise_windows; // averaged, back to work()
+      std::condition_variable d_noise_cond; // signaled when a noise window arrives
+      std::thread d_noise_thread;
+      uint64_t d_quiet_samples; // samples searched since the last frame was found
+      uint64_t d_next_noise_window; // d_quiet_samples when the next noise window can be taken
+      uint64_t d_noise_hold_off; // d_quiet_samples until which a loud window may be the payload of an unparsed frame
+      float d_noise_window_energy; // energy of the last noise window taken
+      std::mutex d_noise_psd_mutex;
+      light_plc::tones_float_t d_noise_psd; // guarded by d_noise_psd_mutex
+      bool d_noise_psd_valid; // guarded by d_noise_psd_mutex
+
+      int min_input() const;
+      int squelch(const gr_complex *in, int n);
+      void sliding_correlation(const gr_complex *in, int n);
+      void consume_correlation(int n);
+      bool above_threshold(float corr, float energy_product) const {
+        return energy_product > 0 && corr * std::fabs(corr) > d_threshold_sq * energy_product;
+      }
+      void feed_noise_estimator(int n);
+      void noise_estimator();
+      void decoder(size_t index);
+      pmt::pmt_t decode_frame(decoder_t &decoder, rx_frame_t &frame);
+      void decoder_command(decoder_t &decoder, const command_t &command);
+      void publish(uint64_t seq, pmt::pmt_t frame, size_t decoder);
+      bool wait_for_decoder_input(decoder_t &decoder, const std::function<bool()> &ready);
+      void notify_decoder(decoder_t &decoder);
 
      public:
       phy_rx_impl(float threshold, int log_level);
       ~phy_rx_impl();
       void mac_in (pmt::pmt_t msg);
       void forecast (int noutput_items, gr_vector_int &ninput_items_required);
-      // Copy data into a circular buffer
-      void copy_to_circular_buffer(void *buffer, size_t buffer_size, size_t &buffer_offset, const void* src, size_t size, size_t datatype_size);
-      // Copy data from a circular buffer
-      void copy_from_circular_buffer(void *dest, void *buffer, size_t buffer_size, size_t buffer_offset, size_t size, size_t datatype_size);
       // Where all the action really happens
       int work(int noutput_items,
 	       gr_vector_const_void_star &input_items,
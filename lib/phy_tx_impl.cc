@@ -29,6 +29,9 @@
 namespace gr {
   namespace plc {
 
+    const size_t phy_tx_impl::MAX_PENDING_MPDUS = 16;
+    const size_t phy_tx_impl::MAX_PREPARED_PPDUS = 2;
+
     phy_tx::sptr
     phy_tx::make(int log_level)
     {
@@ -49,8 +52,8 @@ namespace gr {
             d_datastream_offset(0),
             d_datastream_len(0),
             d_samples_since_last_tx(0),
-            d_frame_ready(false),
-            d_transmitter_state(HALT)
+            d_transmitter_state(HALT),
+            d_stop_encoder(false)
     {
       message_port_register_in(pmt::mp("mac in"));
       set_msg_handler(pmt::mp("mac in"), boost::bind(&phy_tx_impl::mac_in, this, _1));
@@ -62,6 +65,13 @@ namespace gr {
      */
     phy_tx_impl::~phy_tx_impl()
     {
+      {
+        std::lock_guard<std::mutex> lock(d_queue_mutex);
+        d_stop_encoder = true;
+      }
+      d_queue_cond.notify_all();
+      if (d_encoder_thread.joinable())
+        d_encoder_thread.join();
     }
 
     void phy_tx_impl::mac_in (pmt::pmt_t msg) {
@@ -72,11 +82,7 @@ namespace gr {
       pmt::pmt_t dict = pmt::cdr(msg);
 
       if (cmd == "PHY-TXCONFIG") {
-        if (d_transmitter_state == PREPARING) {
-          PRINT_NOTICE("cannot config while preparing for tx");
-          return;
-        }
-        // Set tone map
+        // Set tone map, PPDUs already encoded keep the one they were encoded with
         if (pmt::dict_has_key(dict,pmt::mp("tone_map"))) {
           PRINT_DEBUG("setting custom tx tone map");
           pmt::pmt_t tone_map_pmt = pmt::dict_ref(dict, pmt::mp("tone_map"), pmt::PMT_NIL);
@@ -85,7 +91,8 @@ namespace gr {
           light_plc::tone_map_t tone_map;
           for (size_t j = 0; j<tone_map_len; j++)
             tone_map[j] = (light_plc::modulation_type_t)tone_map_blob[j];
-          d_phy_service.set_tone_map(tone_map);
+          std::lock_guard<std::mutex> lock(d_config_mutex);
+          d_encoder_phy_service.set_tone_map(tone_map);
         }
       }
 
@@ -130,6 +137,8 @@ namespace gr {
 
             d_phy_service = light_plc::phy_service(tone_mask, tone_mask, sync_tone_mask, channel_est_mode, d_log_level >= 3);
           }
+          d_encoder_phy_service = d_phy_service;
+          d_encoder_thread = std::thread(&phy_tx_impl::encoder, this);
 
           d_transmitter_state = READY;
           d_init_done = true;
@@ -139,35 +148,58 @@ namespace gr {
       }
 
       else if (cmd == "PHY-TXSTART") {
-        if (d_transmitter_state == READY) {
+        if (d_transmitter_state != HALT) {
           // Get frame control
           pmt::pmt_t mpdu_fc_pmt = pmt::dict_ref(dict, pmt::mp("frame_control"), pmt::PMT_NIL);
           size_t mpdu_fc_length = 0;
           const unsigned char *mpdu_fc = pmt::u8vector_elements(mpdu_fc_pmt, mpdu_fc_length);
-          d_mpdu_fc = std::vector<unsigned char>(mpdu_fc, mpdu_fc + mpdu_fc_length);
           // Get payload
           size_t mpdu_payload_length = 0;
           const unsigned char *mpdu_payload = NULL;
-          d_mpdu_payload = std::vector<unsigned char>(0);
+          std::vector<unsigned char> payload;
           if (pmt::dict_has_key(dict,pmt::mp("payload"))) {
             pmt::pmt_t mpdu_payload_pmt = pmt::dict_ref(dict, pmt::mp("payload"), pmt::PMT_NIL);
             mpdu_payload = pmt::u8vector_elements(mpdu_payload_pmt, mpdu_payload_length);
-            d_mpdu_payload = std::vector<unsigned char>(mpdu_payload, mpdu_payload + mpdu_payload_length);
+            payload = std::vector<unsigned char>(mpdu_payload, mpdu_payload + mpdu_payload_length);
+          }
+          // Queue it for the encoder thread
+          std::lock_guard<std::mutex> lock(d_queue_mutex);
+          if (d_mpdu_queue.size() < MAX_PENDING_MPDUS) {
+            PRINT_DEBUG("received new MPDU from MAC");
+            d_mpdu_queue.push_back(std::make_pair(std::vector<unsigned char>(mpdu_fc, mpdu_fc + mpdu_fc_length), payload));
+            d_queue_cond.notify_all();
+          } else {
+            PRINT_NOTICE("transmit queue is full, dropping MPDU");
           }
-          PRINT_DEBUG("received new MPDU from MAC");
-          d_transmitter_state = PREPARING;
-          std::thread{&phy_tx_impl::create_ppdu, this}.detach(); // creating the PPDU in a new thread not to starve the work routine
         } else {
-          PRINT_NOTICE("received MPDU while transmitter is not ready, dropping MPDU");
+          PRINT_NOTICE("received MPDU while transmitter is not initialized, dropping MPDU");
         }
       }
     }
 
-    void phy_tx_impl::create_ppdu() {
-      d_datastream = d_phy_service.create_ppdu(d_mpdu_fc.data(), d_mpdu_fc.size(), d_mpdu_payload.data(), d_mpdu_payload.size());
-      d_datastream_len = d_datastream.size();
-      d_frame_ready = true;
-      return;
+    void phy_tx_impl::encoder() {
+      // Encode the queued MPDUs ahead, so the next PPDU is ready when the current one ends.
+      // Only the encoding is done here, work() generates the samples symbol by symbol
+      while (true) {
+        std::pair<std::vector<unsigned char>, std::vector<unsigned char> > mpdu;
+        {
+          std::unique_lock<std::mutex> lock(d_queue_mutex);
+          d_queue_cond.wait(lock, [this] { return d_stop_encoder || (!d_mpdu_queue.empty() && d_ppdu_queue.size() < MAX_PREPARED_PPDUS); });
+          if (d_stop_encoder)
+            return;
+          mpdu = std::move(d_mpdu_queue.front());
+          d_mpdu_queue.pop_front();
+        }
+
+        light_plc::phy_service::tx_state_t ppdu;
+        {
+          std::lock_guard<std::mutex> lock(d_config_mutex);
+          d_encoder_phy_service.prepare_ppdu(ppdu, mpdu.first.data(), mpdu.first.size(), mpdu.second.data(), mpdu.second.size());
+        }
+
+        std::lock_guard<std::mutex> lock(d_queue_mutex);
+        d_ppdu_queue.push_back(std::move(ppdu));
+      }
     }
 
     int
@@ -180,7 +212,7 @@ namespace gr {
 
         switch (d_transmitter_state) {
           case TX: {
-            i = std::min(noutput_items, d_datastream_len - d_datastream_offset);
+            i = d_phy_service.generate_ppdu(d_ppdu, out, std::min(noutput_items, d_datastream_len - d_datastream_offset));
             if (d_datastream_offset == 0 && i > 0) {
               // add tags
               pmt::pmt_t key = pmt::string_to_symbol("packet_len");
@@ -189,7 +221,6 @@ namespace gr {
               add_item_tag(0, nitems_written(0), key, value, srcid);
             }
 
-            std::memcpy(out, &d_datastream[d_datastream_offset], sizeof(light_plc::vector_complex::value_type)*i);
             d_datastream_offset += i;
             PRINT_DEBUG("state = TX, copied " + std::to_string(d_datastream_offset) + "/" + std::to_string(d_datastream_len));
 
@@ -199,26 +230,36 @@ namespace gr {
               d_datastream_len = 0;
               d_samples_since_last_tx = 0;
               d_transmitter_state = READY;
-              d_frame_ready = false;
               pmt::pmt_t dict = pmt::make_dict();
               message_port_pub(pmt::mp("mac out"), pmt::cons(pmt::mp("PHY-TXEND"), dict));
             }
             break;
           }
 
-          case PREPARING:
-            if (d_frame_ready) {
-              if (d_samples_since_last_tx >= d_interframe_space)
-                d_transmitter_state = TX;
-              else {
-                i = std::min(d_interframe_space - d_samples_since_last_tx, noutput_items);
-                d_samples_since_last_tx += i;
-                std::memset(out, 0, sizeof(gr_complex)*i);
-              }
-              break;
+          case INTERFRAME:
+            if (d_samples_since_last_tx >= d_interframe_space)
+              d_transmitter_state = TX;
+            else {
+              i = std::min(d_interframe_space - d_samples_since_last_tx, noutput_items);
+              d_samples_since_last_tx += i;
+              std::memset(out, 0, sizeof(gr_complex)*i);
             }
+            break;
 
           case READY: {
+            // Take the next encoded PPDU, if there is one
+            {
+              std::lock_guard<std::mutex> lock(d_queue_mutex);
+              if (!d_ppdu_queue.empty()) {
+                d_ppdu = std::move(d_ppdu_queue.front());
+                d_ppdu_queue.pop_front();
+                d_datastream_len = d_ppdu.length;
+                d_transmitter_state = INTERFRAME;
+                d_queue_cond.notify_all(); // room for the encoder
+              }
+            }
+            if (d_transmitter_state == INTERFRAME)
+              break;
             i = noutput_items;
             std::memset(out, 0, sizeof(gr_complex)*i);
             pmt::pmt_t key = pmt::string_to_symbol("packet_len");
@@ -22,6 +22,10 @@
 #include <plc/phy_tx.h>
 #include <lightplc/phy_service.h>
 #include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace gr {
   namespace plc {
@@ -30,25 +34,34 @@ namespace gr {
     {
      private:
       static const int SILENCE_PERIOD;
+      static const size_t MAX_PENDING_MPDUS;
+      static const size_t MAX_PREPARED_PPDUS;
 
-      light_plc::phy_service d_phy_service;
+      light_plc::phy_service d_phy_service; // generates the samples in work()
+      light_plc::phy_service d_encoder_phy_service; // encodes the PPDUs in the encoder thread
       int d_interframe_space;
       const int d_log_level;
       bool d_init_done;
-      light_plc::vector_complex d_datastream;
       int d_datastream_offset;
       int d_datastream_len;
       int d_samples_since_last_tx;
-      bool d_frame_ready;
-      enum {READY, PREPARING, TX, HALT} d_transmitter_state;
-      std::vector<unsigned char> d_mpdu_fc, d_mpdu_payload;
+      enum {READY, INTERFRAME, TX, HALT} d_transmitter_state;
+      light_plc::phy_service::tx_state_t d_ppdu; // the PPDU on the air
+      std::deque<std::pair<std::vector<unsigned char>, std::vector<unsigned char> > > d_mpdu_queue; // frame control and payload to encode
+      std::deque<light_plc::phy_service::tx_state_t> d_ppdu_queue; // encoded PPDUs waiting for their turn
+      std::mutex d_queue_mutex;
+      std::condition_variable d_queue_cond;
+      std::mutex d_config_mutex; // guards d_encoder_phy_service
+      std::thread d_encoder_thread;
+      bool d_stop_encoder;
+
+      void encoder();
 
      public:
       phy_tx_impl(int log_level);
       ~phy_tx_impl();
 
 	  void mac_in (pmt::pmt_t msg);
-    void create_ppdu();
 
       // Where all the action really happens
       int work(int noutput_items,
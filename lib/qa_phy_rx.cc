@@ -0,0 +1,121 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qa_phy_rx.h"
+#include "phy_rx_impl.h"
+#include <gnuradio/top_block.h>
+#include <gnuradio/blocks/vector_source_c.h>
+#include <cppunit/TestAssert.h>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <thread>
+
+namespace gr {
+  namespace plc {
+
+    static const int GAP = 150000; // noise samples around the frame, enough for several noise windows
+    static const float NOISE_SIGMA = 0.003;
+    static const float FRAME_AMPLITUDE = 0.1;
+
+    void qa_phy_rx::make_stream(bool corrupt_frame_control, light_plc::vector_complex &noise, light_plc::vector_complex &stream) {
+      // A SOF of three 520 octet blocks in STD-ROBO between two gaps, and the same noise without the frame
+      std::mt19937 rng(1);
+      light_plc::vector_int fc(IEEE1901_FRAME_CONTROL_NBITS, 0);
+      light_plc::set_field(fc, IEEE1901_FRAME_CONTROL_DT_IH_OFFSET, IEEE1901_FRAME_CONTROL_DT_IH_WIDTH, 1);
+      light_plc::bitstream_t fc_bits(fc);
+      std::vector<unsigned char> payload(3 * 520);
+      for (size_t j = 0; j < payload.size(); j++)
+        payload[j] = rng();
+      light_plc::phy_service tx(false);
+      light_plc::vector_complex ppdu = tx.create_ppdu(fc_bits, light_plc::bitstream_t(payload.data(), payload.size()));
+
+      std::normal_distribution<float> normal(0, NOISE_SIGMA);
+      noise.resize(2 * GAP + ppdu.size());
+      for (size_t j = 0; j < noise.size(); j++)
+        noise[j] = gr_complex(normal(rng), normal(rng));
+      stream = noise;
+      std::uniform_real_distribution<float> angle(0, 2 * M_PI);
+      for (size_t j = 0; j < ppdu.size(); j++) {
+        gr_complex sample = ppdu[j];
+        bool frame_control = (int)j >= light_plc::phy_service::PREAMBLE_SIZE &&
+                             (int)j < light_plc::phy_service::PREAMBLE_SIZE + light_plc::phy_service::FRAME_CONTROL_SIZE;
+        if (corrupt_frame_control && frame_control)
+          sample = std::polar(std::abs(sample), angle(rng));
+        stream[GAP + j] += sample * FRAME_AMPLITUDE;
+      }
+    }
+
+    float qa_phy_rx::noise_estimate(const light_plc::vector_complex &samples, bool drop_frames) {
+      // Mean of the noise PSD a receiver estimated in the background while it went through samples
+      boost::shared_ptr<phy_rx_impl> rx = gnuradio::get_initial_sptr(new phy_rx_impl(0.9, 0));
+      light_plc::tone_mask_t mask = {IEEE1901_DEFAULT_TONE_MASK};
+      light_plc::sync_tone_mask_t sync_mask = {IEEE1901_SYNCP_TONE_MASK};
+      std::vector<uint8_t> mask_u8(mask.begin(), mask.end()), sync_mask_u8(sync_mask.begin(), sync_mask.end());
+      pmt::pmt_t dict = pmt::make_dict();
+      dict = pmt::dict_add(dict, pmt::mp("broadcast_tone_mask"), pmt::init_u8vector(mask_u8.size(), mask_u8.data()));
+      dict = pmt::dict_add(dict, pmt::mp("sync_tone_mask"), pmt::init_u8vector(sync_mask_u8.size(), sync_mask_u8.data()));
+      dict = pmt::dict_add(dict, pmt::mp("channel_est_mode"), pmt::from_long(light_plc::CE_PREAMBLE));
+      dict = pmt::dict_add(dict, pmt::mp("interframe_space"), pmt::from_long(10000));
+      rx->mac_in(pmt::cons(pmt::mp("PHY-RXINIT"), dict));
+      if (drop_frames) {
+        // Take every frame buffer, so the decoders are busy when a frame arrives
+        phy_rx_impl::rx_frame_t *frame;
+        for (size_t k = 0; k < rx->d_decoders.size(); k++)
+          while (rx->d_decoders[k]->free_frames.pop(frame));
+      }
+
+      gr::top_block_sptr tb = gr::make_top_block("qa_phy_rx");
+      tb->connect(blocks::vector_source_c::make(samples), 0, rx, 0);
+      tb->run();
+
+      // work() is done, the windows still queued are averaged once they are all free again
+      size_t n_free = 0;
+      light_plc::vector_complex *window;
+      for (int k = 0; k < 1000 && n_free < phy_rx_impl::NOISE_WINDOWS; k++) {
+        while (rx->d_free_noise_windows.pop(window))
+          n_free++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      CPPUNIT_ASSERT_EQUAL((size_t)phy_rx_impl::NOISE_WINDOWS, n_free);
+
+      std::lock_guard<std::mutex> lock(rx->d_noise_psd_mutex);
+      CPPUNIT_ASSERT(rx->d_noise_psd_valid);
+      return std::accumulate(rx->d_noise_psd.begin(), rx->d_noise_psd.end(), 0.0f) / rx->d_noise_psd.size();
+    }
+
+    void
+    qa_phy_rx::t_dropped_frame_noise()
+    {
+      // The payload of a frame the busy decoders cannot take is skipped, not averaged as noise
+      light_plc::vector_complex noise, stream;
+      make_stream(false, noise, stream);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, noise_estimate(stream, true) / noise_estimate(noise, false), 0.5);
+    }
+
+    void
+    qa_phy_rx::t_unparsed_frame_noise()
+    {
+      // The payload after a frame control that cannot be parsed is searched, but not averaged as noise
+      light_plc::vector_complex noise, stream;
+      make_stream(true, noise, stream);
+      CPPUNIT_ASSERT_DOUBLES_EQUAL(1.0, noise_estimate(stream, false) / noise_estimate(noise, false), 0.5);
+    }
+
+  } /* namespace plc */
+} /* namespace gr */
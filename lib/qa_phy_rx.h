@@ -0,0 +1,47 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_PLC_QA_PHY_RX_H
+#define INCLUDED_PLC_QA_PHY_RX_H
+
+#include <cppunit/extensions/HelperMacros.h>
+#include <cppunit/TestCase.h>
+#include <lightplc/phy_service.h>
+
+namespace gr {
+  namespace plc {
+
+    class qa_phy_rx : public CppUnit::TestCase
+    {
+     public:
+      CPPUNIT_TEST_SUITE(qa_phy_rx);
+      CPPUNIT_TEST(t_dropped_frame_noise);
+      CPPUNIT_TEST(t_unparsed_frame_noise);
+      CPPUNIT_TEST_SUITE_END();
+
+     private:
+      void t_dropped_frame_noise();
+      void t_unparsed_frame_noise();
+      static void make_stream(bool corrupt_frame_control, light_plc::vector_complex &noise, light_plc::vector_complex &stream);
+      static float noise_estimate(const light_plc::vector_complex &samples, bool drop_frames);
+    };
+
+  } // namespace plc
+} // namespace gr
+
+#endif /* INCLUDED_PLC_QA_PHY_RX_H */
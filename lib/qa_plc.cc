@@ -0,0 +1,35 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * This class gathers together all the test cases for the gr-plc
+ * directory into a single test suite.  As you create new test cases,
+ * add them here.
+ */
+
+#include "qa_plc.h"
+#include "qa_phy_rx.h"
+
+CppUnit::TestSuite *
+qa_plc::suite()
+{
+  CppUnit::TestSuite *s = new CppUnit::TestSuite("plc");
+  s->addTest(gr::plc::qa_phy_rx::suite());
+
+  return s;
+}
@@ -0,0 +1,107 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sample_ring.h"
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+namespace gr {
+  namespace plc {
+
+    static int create_shared_memory() {
+      // Anonymous shared memory object to map twice, returns -1 and sets errno on failure
+#ifdef SYS_memfd_create
+      int fd = syscall(SYS_memfd_create, "gr-plc-ring", 0);
+      if (fd >= 0 || errno != ENOSYS)
+        return fd;
+#endif
+      // Otherwise a named object unlinked right away, so only the mappings keep it. The name stays
+      // within the 31 characters macOS allows
+      static std::atomic<unsigned int> counter(0);
+      char name[32];
+      snprintf(name, sizeof(name), "/gr-plc-%x-%x", (unsigned int)getpid(), counter++);
+      int fd_shm = shm_open(name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+      if (fd_shm >= 0)
+        shm_unlink(name);
+      return fd_shm;
+    }
+
+    sample_ring::sample_ring(size_t min_size) : d_base(NULL), d_size(0), d_offset(0) {
+      size_t page_size = sysconf(_SC_PAGESIZE);
+      size_t n_bytes = (min_size * sizeof(gr_complex) + page_size - 1) / page_size * page_size;
+      assert(n_bytes % sizeof(gr_complex) == 0);
+
+      int fd = create_shared_memory();
+      if (fd < 0)
+        throw std::runtime_error("sample_ring: cannot create shared memory: " + std::string(strerror(errno)));
+      if (ftruncate(fd, n_bytes) < 0) {
+        close(fd);
+        throw std::runtime_error("sample_ring: ftruncate failed: " + std::string(strerror(errno)));
+      }
+
+      // Reserve twice the size, then map the object over both halves
+      void *base = mmap(NULL, 2 * n_bytes, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (base == MAP_FAILED) {
+        close(fd);
+        throw std::runtime_error("sample_ring: mmap failed: " + std::string(strerror(errno)));
+      }
+      for (int half = 0; half < 2; half++) {
+        void *addr = (char *)base + half * n_bytes;
+        if (mmap(addr, n_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != addr) {
+          munmap(base, 2 * n_bytes);
+          close(fd);
+          throw std::runtime_error("sample_ring: mmap failed: " + std::string(strerror(errno)));
+        }
+      }
+      close(fd);
+
+      d_base = (gr_complex *)base;
+      d_size = n_bytes / sizeof(gr_complex);
+    }
+
+    sample_ring::~sample_ring() {
+      munmap(d_base, 2 * d_size * sizeof(gr_complex));
+    }
+
+    void sample_ring::write(const gr_complex *src, size_t n) {
+      if (n > d_size) {
+        src += n - d_size;
+        n = d_size;
+      }
+      memcpy(d_base + d_offset, src, n * sizeof(gr_complex)); // may run into the second mapping
+      d_offset = (d_offset + n) % d_size;
+    }
+
+    const gr_complex *sample_ring::last(size_t n) const {
+      assert(n <= d_size);
+      return d_base + d_offset + d_size - n;
+    }
+
+  } /* namespace plc */
+} /* namespace gr */
@@ -0,0 +1,57 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_PLC_SAMPLE_RING_H
+#define INCLUDED_PLC_SAMPLE_RING_H
+
+#include <gnuradio/gr_complex.h>
+#include <cstddef>
+
+namespace gr {
+  namespace plc {
+
+    /*
+     * Ring buffer keeping the last samples written to it. The same pages are mapped twice back to
+     * back, so the last n <= size() samples are always contiguous in memory and writes never wrap.
+     */
+    class sample_ring
+    {
+     public:
+      // The size is min_size rounded up to whole pages. Throws std::runtime_error if the memory cannot be mapped
+      explicit sample_ring(size_t min_size);
+      ~sample_ring();
+
+      size_t size() const { return d_size; }
+      // Appends n samples, only the last size() of them are kept when n > size()
+      void write(const gr_complex *src, size_t n);
+      // The last n samples written, oldest first
+      const gr_complex *last(size_t n) const;
+
+     private:
+      sample_ring(const sample_ring &);
+      sample_ring &operator=(const sample_ring &);
+
+      gr_complex *d_base; // first mapping, the second one follows at d_base + d_size
+      size_t d_size;
+      size_t d_offset; // next write position, in [0, d_size)
+    };
+
+  } // namespace plc
+} // namespace gr
+
+#endif /* INCLUDED_PLC_SAMPLE_RING_H */
@@ -0,0 +1,69 @@
+/*
+ * Gr-plc - IEEE 1901 module for GNU Radio
+ * Copyright (C) 2016 Roee Bar <roeeb@ece.ubc.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INCLUDED_PLC_SPSC_QUEUE_H
+#define INCLUDED_PLC_SPSC_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+namespace gr {
+  namespace plc {
+
+    /*
+     * Lock-free queue of up to N items between one producer thread and one consumer thread.
+     * push() may only be called by the producer and pop() only by the consumer.
+     */
+    template <typename T, size_t N>
+    class spsc_queue
+    {
+     public:
+      spsc_queue() : d_head(0), d_tail(0) {}
+
+      // Returns false if the queue is full
+      bool push(const T &item) {
+        size_t tail = d_tail.load(std::memory_order_relaxed);
+        if (tail - d_head.load(std::memory_order_acquire) == N)
+          return false;
+        d_items[tail % N] = item;
+        d_tail.store(tail + 1, std::memory_order_release); // publish the item
+        return true;
+      }
+
+      // Returns false if the queue is empty
+      bool pop(T &item) {
+        size_t head = d_head.load(std::memory_order_relaxed);
+        if (head == d_tail.load(std::memory_order_acquire))
+          return false;
+        item = d_items[head % N];
+        d_head.store(head + 1, std::memory_order_release); // free the slot
+        return true;
+      }
+
+     private:
+      std::array<T, N> d_items;
+      std::atomic<size_t> d_head; // next item to pop, written by the consumer
+      char d_padding[64]; // keeps the two indices out of the same cache line
+      std::atomic<size_t> d_tail; // next slot to push, written by the producer
+    };
+
+  } // namespace plc
+} // namespace gr
+
+#endif /* INCLUDED_PLC_SPSC_QUEUE_H */